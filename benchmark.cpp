@@ -0,0 +1,343 @@
+#include "file_data_structures.h"
+#include "trace.h"
+#include "timing.h"
+#include <random>
+
+#define BENCH_BLOCK_SIZE 1024
+#define BENCH_BLOCK_COUNT MAX_BLOCKS
+#define BENCH_SEED 1
+#define WARMUP 3
+#define REPETITIONS 25
+
+// calls timed together in every sample of the cheap primitives
+#define BATCH 64
+
+// files are between 1 and MAX_FILE_BLOCKS blocks when filling the
+// directory, and between 1 and CREATE_BLOCKS blocks when creating
+#define MAX_FILE_BLOCKS 64
+#define CREATE_BLOCKS 8
+
+#define PATTERN_PACKED 0
+#define PATTERN_FRAGMENTED 1
+
+// blocks of the directory extend time is measured on against file
+// length, enough to hold the longest file of ExtendLengths, and the
+// size of its groups when blocks are placed near a goal
+#define LENGTH_BLOCK_COUNT (1 << 17)
+#define LENGTH_GROUP_SIZE (1 << 13)
+
+double FillLevels[] = {0.10, 0.25, 0.50, 0.75, 0.90, 0.99};
+
+BlockIndex ExtendLengths[] = {1, 64, 4096, 65536};
+
+string PatternNames[] = {"packed", "fragmented"};
+
+Timer Clock;
+
+/*
+  This function fills a fresh allocation method until the given fraction
+  of its blocks is taken. With PATTERN_PACKED files are created one after
+  the other, so free space is a single run at the end. With
+  PATTERN_FRAGMENTED the directory is filled completely first, then
+  random files are shrunk until the fraction is reached, which leaves
+  holes of random length behind files all over the directory. The IDs of
+  the files created are added to IDs
+*/
+template<typename Strategy>
+void Populate(Strategy& A, double fill, int pattern, vector<int>& IDs, mt19937_64& Rand) {
+
+  BlockIndex target = fill * A.block_count;
+  BlockIndex goal = pattern == PATTERN_PACKED ? target : A.block_count;
+
+  while (A.block_count - A.available_space < goal) {
+
+    BlockIndex left = goal - (A.block_count - A.available_space);
+    BlockIndex blocks = min((BlockIndex) (1 + Rand() % MAX_FILE_BLOCKS), left);
+    int ID = IDs.size() + 1;
+
+    if (A.CreateFile(ID, blocks * A.block_size) != SUCCESS) break;
+
+    IDs.push_back(ID);
+  }
+
+  // every file keeps at least one block, files average many more
+  // blocks than the lowest fill level so this always terminates
+  while (target < A.block_count - A.available_space) {
+
+    int ID = IDs[Rand() % IDs.size()];
+    BlockIndex length = A.Table.Find(ID)->block_len;
+
+    if (length == 1) continue;
+
+    BlockIndex amount = min((BlockIndex) (1 + Rand() % (length - 1)), A.block_count - A.available_space - target);
+
+    A.Shrink(ID, amount);
+  }
+}
+
+/*
+  Commits every page of the directory, so that pages of a fresh directory
+  that were never written are not faulted in by timed calls
+*/
+template<typename Strategy>
+void Prefault(Strategy& A) {
+
+#ifdef MADV_POPULATE_WRITE
+  madvise(A.Directory.Data, A.Directory.bytes, MADV_POPULATE_WRITE);
+#endif
+}
+
+/*
+  Returns whether the block right after the last block of a file is
+  free, so that extending it by one block needs no relocation for
+  contiguous files and stays sequential for linked files
+*/
+bool RoomAfter(ContiguousAllocation& A, File& F) {
+
+  BlockIndex end = F.index + F.block_len;
+
+  return end < A.block_count && A.Directory[end] == EMPTY;
+}
+
+bool RoomAfter(LinkedAllocation& A, File& F) {
+
+  return F.tail + 1 < A.block_count && A.FreeBlocks.IsFree(F.tail + 1);
+}
+
+/*
+  Adds to Targets up to count calls of the given code with the given
+  amount, on distinct random files for which Keep is true
+*/
+template<typename Strategy, typename Filter>
+void PickFiles(Strategy& A, vector<int> IDs, mt19937_64& Rand, int code, long long amount, int count, vector<Op>& Targets, Filter Keep) {
+
+  shuffle(IDs.begin(), IDs.end(), Rand);
+
+  for (int i = 0 ; i < (int) IDs.size() && (int) Targets.size() < count ; ++i) {
+
+    File& F = *A.Table.Find(IDs[i]);
+
+    if (Keep(F)) Targets.push_back(Op(code, IDs[i], amount));
+  }
+}
+
+/*
+  This function measures one primitive of an allocation method. Every
+  repetition builds a fresh allocation method filled as given, lets Pick
+  choose the calls to make, untimed, and then times Run over all of them
+  together. The first WARMUP repetitions are not recorded. It prints the
+  statistics of the time per call over the recorded repetitions, and the
+  share of calls that failed or were rejected. Directories have
+  block_count blocks and are built with the given settings after it.
+*/
+template<typename Strategy, typename Choose, typename Call, typename... Settings>
+void Measure(string strategy, string primitive, double fill, int pattern, Choose Pick, Call Run, BlockIndex block_count = BENCH_BLOCK_COUNT, Settings... settings) {
+
+  vector<double> Samples;
+  long long calls = 0;
+  long long failed = 0;
+
+  for (int r = 0 ; r < WARMUP + REPETITIONS ; ++r) {
+
+    Strategy A(BENCH_BLOCK_SIZE, block_count, settings...);
+    mt19937_64 Rand(BENCH_SEED);
+    vector<int> IDs;
+    vector<Op> Targets;
+
+    Populate(A, fill, pattern, IDs, Rand);
+    Prefault(A);
+    Pick(A, IDs, Rand, Targets);
+
+    if (Targets.empty()) continue;
+
+    int done = 0;
+
+    long long start = Clock.Start();
+
+    for (const Op& op : Targets) done += Run(A, op);
+
+    long long stop = Clock.Stop();
+
+    if (r < WARMUP) continue;
+
+    Samples.push_back((double) Clock.Elapsed(start, stop) / Targets.size());
+    calls += Targets.size();
+    failed += Targets.size() - done;
+  }
+
+  if (Samples.empty()) {
+    printf("%-12s %-11s %5.0f%%  %-16s  no candidate calls\n", strategy.c_str(), PatternNames[pattern].c_str(), fill * 100, primitive.c_str());
+    return;
+  }
+
+  sort(Samples.begin(), Samples.end());
+
+  double mean = 0.0, deviation = 0.0;
+
+  for (double x : Samples) mean += x;
+
+  mean /= Samples.size();
+
+  for (double x : Samples) deviation += (x - mean) * (x - mean);
+
+  deviation = sqrt(deviation / Samples.size());
+
+  printf("%-12s %-11s %5.0f%%  %-16s %5lld %11.1f %11.1f %11.1f %11.1f %10.1f %7.1f%%\n",
+    strategy.c_str(), PatternNames[pattern].c_str(), fill * 100, primitive.c_str(), calls / (long long) Samples.size(),
+    Samples[Samples.size() / 2], mean, Samples.front(), Samples.back(), deviation, 100.0 * failed / calls);
+}
+
+/*
+  This function measures the primitives both allocation methods have,
+  at the given fill level and pattern
+*/
+template<typename Strategy>
+void BenchCommon(string strategy, double fill, int pattern) {
+
+  Measure<Strategy>(strategy, "CreateFile", fill, pattern,
+    [](Strategy& A, vector<int>& IDs, mt19937_64& Rand, vector<Op>& Targets) {
+      for (int i = 0 ; i < BATCH ; ++i) {
+        Targets.push_back(Op(OP_CREATE, IDs.size() + 1 + i, (1 + Rand() % CREATE_BLOCKS) * A.block_size));
+      }
+    },
+    [](Strategy& A, const Op& op) { return A.CreateFile(op.arg1, op.arg2) == SUCCESS; });
+
+  // offsets at the first block, halfway and at the last block of files
+  string OffsetNames[] = {"Access start", "Access middle", "Access end"};
+
+  for (int k = 0 ; k < 3 ; ++k) {
+
+    Measure<Strategy>(strategy, OffsetNames[k], fill, pattern,
+      [k](Strategy& A, vector<int>& IDs, mt19937_64& Rand, vector<Op>& Targets) {
+        for (int i = 0 ; i < BATCH ; ++i) {
+          int ID = IDs[Rand() % IDs.size()];
+          long long bytes = A.Table.Find(ID)->byte_len;
+          Targets.push_back(Op(OP_ACCESS, ID, max(bytes * k / 2, 1LL)));
+        }
+      },
+      [](Strategy& A, const Op& op) { return A.Access(op.arg1, op.arg2) != FAIL; });
+  }
+
+  Measure<Strategy>(strategy, "Extend room", fill, pattern,
+    [](Strategy& A, vector<int>& IDs, mt19937_64& Rand, vector<Op>& Targets) {
+      PickFiles(A, IDs, Rand, OP_EXTEND, 1, BATCH, Targets, [&](File& F) { return RoomAfter(A, F); });
+    },
+    [](Strategy& A, const Op& op) { return A.Extend(op.arg1, op.arg2) == SUCCESS; });
+
+  // a contiguous extension without room compacts the whole directory,
+  // which changes every other file, so only one call is timed
+  Measure<Strategy>(strategy, "Extend no room", fill, pattern,
+    [](Strategy& A, vector<int>& IDs, mt19937_64& Rand, vector<Op>& Targets) {
+      PickFiles(A, IDs, Rand, OP_EXTEND, 1, 1, Targets, [&](File& F) { return !RoomAfter(A, F); });
+    },
+    [](Strategy& A, const Op& op) { return A.Extend(op.arg1, op.arg2) == SUCCESS; });
+
+  Measure<Strategy>(strategy, "Shrink", fill, pattern,
+    [](Strategy& A, vector<int>& IDs, mt19937_64& Rand, vector<Op>& Targets) {
+      PickFiles(A, IDs, Rand, OP_SHRINK, 1, BATCH, Targets, [](File& F) { return 1 < F.block_len; });
+    },
+    [](Strategy& A, const Op& op) { return A.Shrink(op.arg1, op.arg2) == SUCCESS; });
+}
+
+/*
+  This function measures the primitives of contiguous allocation
+*/
+void BenchContiguous(double fill, int pattern) {
+
+  BenchCommon<ContiguousAllocation>("Contiguous", fill, pattern);
+
+  Measure<ContiguousAllocation>("Contiguous", "FindAvailable", fill, pattern,
+    [](ContiguousAllocation&, vector<int>&, mt19937_64& Rand, vector<Op>& Targets) {
+      for (int i = 0 ; i < BATCH ; ++i) {
+        Targets.push_back(Op(OP_INVALID, 1 + Rand() % MAX_FILE_BLOCKS, 0));
+      }
+    },
+    [](ContiguousAllocation& A, const Op& op) { return A.FindAvailableSpace(op.arg1) != FAIL; });
+
+  Measure<ContiguousAllocation>("Contiguous", "ApplyCompaction", fill, pattern,
+    [](ContiguousAllocation&, vector<int>&, mt19937_64&, vector<Op>& Targets) {
+      Targets.push_back(Op(OP_INVALID, DIRECTORY_START, 0));
+    },
+    [](ContiguousAllocation& A, const Op& op) { return A.ApplyCompaction(op.arg1) == SUCCESS; });
+
+  Measure<ContiguousAllocation>("Contiguous", "Shift", fill, pattern,
+    [](ContiguousAllocation& A, vector<int>& IDs, mt19937_64& Rand, vector<Op>& Targets) {
+      PickFiles(A, IDs, Rand, OP_INVALID, 1, BATCH, Targets, [&](File& F) { return RoomAfter(A, F); });
+    },
+    [](ContiguousAllocation& A, const Op& op) { return A.Shift(op.arg1, op.arg2) == SUCCESS; });
+}
+
+/*
+  This function measures the primitives of linked allocation
+*/
+void BenchLinked(double fill, int pattern) {
+
+  BenchCommon<LinkedAllocation>("Linked", fill, pattern);
+
+  Measure<LinkedAllocation>("Linked", "FindAvailable", fill, pattern,
+    [](LinkedAllocation&, vector<int>&, mt19937_64& Rand, vector<Op>& Targets) {
+      for (int i = 0 ; i < BATCH ; ++i) {
+        Targets.push_back(Op(OP_INVALID, 1 + Rand() % MAX_FILE_BLOCKS, 0));
+      }
+    },
+    [](LinkedAllocation& A, const Op& op) { return (long long) A.FindAvailableSpace(op.arg1).size() == op.arg1; });
+}
+
+/*
+  This function measures linked Extend on a single file of every length
+  of ExtendLengths, in an otherwise empty directory, every call appending
+  one block. The last block of a file is kept in the directory table, so
+  appending does not depend on the length of the file. It is measured
+  with blocks placed near a goal, where the new block is found right
+  after the tail, and without, where the lowest free block is searched
+  for from the start of the directory past the whole file
+*/
+void BenchLinkedLength() {
+
+  auto Pick = [](BlockIndex length) {
+    return [length](LinkedAllocation& A, vector<int>&, mt19937_64&, vector<Op>& Targets) {
+      A.CreateFile(1, length * A.block_size);
+      for (int i = 0 ; i < BATCH ; ++i) {
+        Targets.push_back(Op(OP_EXTEND, 1, 1));
+      }
+    };
+  };
+
+  auto Run = [](LinkedAllocation& A, const Op& op) { return A.Extend(op.arg1, op.arg2) == SUCCESS; };
+
+  for (BlockIndex length : ExtendLengths) {
+
+    string primitive = "Extend " + to_string(length);
+
+    Measure<LinkedAllocation>("Linked goal", primitive, 0.0, PATTERN_PACKED, Pick(length), Run, LENGTH_BLOCK_COUNT, 0, (BlockIndex) LENGTH_GROUP_SIZE);
+    Measure<LinkedAllocation>("Linked", primitive, 0.0, PATTERN_PACKED, Pick(length), Run, LENGTH_BLOCK_COUNT);
+  }
+}
+
+/*
+  Times every primitive of contiguous and linked allocation in isolation,
+  on directories filled to every level of FillLevels with every pattern,
+  and linked Extend on files of every length of ExtendLengths. Times are
+  in nanoseconds per call.
+*/
+int main() {
+
+  Clock = Timer(CLOCK_RDTSC);
+
+  printf("%-12s %-11s %6s  %-16s %5s %11s %11s %11s %11s %10s %8s\n",
+    "strategy", "pattern", "fill", "primitive", "calls", "median", "mean", "min", "max", "stddev", "failed");
+
+  for (int pattern = PATTERN_PACKED ; pattern <= PATTERN_FRAGMENTED ; ++pattern) {
+
+    for (double fill : FillLevels) {
+      BenchContiguous(fill, pattern);
+      BenchLinked(fill, pattern);
+    }
+  }
+
+  BenchLinkedLength();
+
+  GetLogQueue().Flush();
+
+  return 0;
+}
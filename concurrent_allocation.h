@@ -0,0 +1,494 @@
+#pragma once
+
+#include "file_data_structures.h"
+#include <mutex>
+
+#define GROUP_COUNT 32
+#define SHARD_COUNT 64
+
+/*
+  This struct type is an allocation group of a ConcurrentAllocation, a
+  range of consecutive blocks with its own free space index and its own
+  lock. It takes a whole cache line so that locks of different groups do
+  not share one. Its attributes:
+
+  Lock:             guards the other attributes, and the blocks of the
+                    group in Directory
+  start:            first block of the group
+  block_count:      number of blocks of the group
+  available_space:  number of free blocks of the group
+  FreeSpace:        indexes the free runs of the group, blocks are counted
+                    from the start of the group
+*/
+struct alignas(64) BlockGroup {
+
+  mutex Lock;
+  BlockIndex start;
+  BlockIndex block_count;
+  BlockIndex available_space;
+  FreeExtentTree FreeSpace;
+};
+
+/*
+  This struct type is a shard of the directory table of a
+  ConcurrentAllocation, holding the files whose ID falls in it. Within a
+  shard files are keyed by their ID divided by the number of shards, so
+  that the dense part of every table stays as compact as a single table
+  would be. Its attributes:
+
+  Lock:     guards the other attributes and the files of the shard
+  Table:    the Directory Table of the shard
+  Extents:  the extents of every file of the shard sorted by logical block
+*/
+struct alignas(64) TableShard {
+
+  mutex Lock;
+  DirectoryTable Table;
+  unordered_map<int, vector<Extent>> Extents;
+};
+
+/*
+  This struct type encapsulates a file system implemented using Extent
+  based allocation that any number of threads can call at once. Blocks
+  are split into allocation groups as in ext4, each with its own free
+  space index and lock, and the directory table is split into shards by
+  file ID, each with its own lock. A call locks the shard of its file for
+  its whole duration, and locks one group at a time while it takes or
+  releases blocks, always after the shard, so calls on files of different
+  shards only meet when they use the same group. New blocks of a file are
+  taken from its home group, and from the following groups when that one
+  is full. Extents never cross groups. The total number of free blocks is
+  a counter updated with atomic operations, so a call is rejected up
+  front when there is not enough room without looking at any group. Its
+  Attributes:
+
+  block_size:       the size of the block
+  available_space:  stores the number of blocks remaning empty, blocks
+                    being taken are subtracted before any group is locked
+  Directory:        stores for every block the ID of the file owning it
+  Groups:           the allocation groups, all of them have the same number
+                    of blocks except the last one which takes the remainder
+  Shards:           the shards of the directory table
+*/
+struct ConcurrentAllocation final : Allocation {
+
+  int block_size;
+  BlockIndex block_count;
+  BlockIndex group_size;
+  atomic<BlockIndex> available_space;
+  BlockStorage<int> Directory;
+  vector<BlockGroup> Groups;
+  vector<TableShard> Shards;
+  GeneralLogger Logger;
+
+  ConcurrentAllocation(int _block_size, BlockIndex _block_count = MAX_BLOCKS, int group_count = GROUP_COUNT, int shard_count = SHARD_COUNT):
+    Groups(max(min((BlockIndex) group_count, _block_count), 1LL)), Shards(max(shard_count, 1)) {
+
+    block_size = _block_size;
+    block_count = _block_count;
+    available_space = block_count;
+    Directory = BlockStorage<int>(block_count);
+    Logger = GeneralLogger("ConcurrentAllocation");
+
+    group_size = max(block_count / (BlockIndex) Groups.size(), 1LL);
+
+    for (int g = 0 ; g < (int) Groups.size() ; ++g) {
+
+      BlockGroup& G = Groups[g];
+
+      G.start = g * group_size;
+      G.block_count = g + 1 < (int) Groups.size() ? group_size : block_count - G.start;
+      G.available_space = G.block_count;
+      G.FreeSpace = FreeExtentTree(G.block_count);
+    }
+  }
+
+  /*
+    Takes length of bytes and returns number of blocks required
+    to store these bytes, which is taken by dividing length by
+    block size and taking the ceil value
+  */
+  BlockIndex ByteToBlock(long long length) {
+
+    return (length + block_size - 1) / block_size;
+  }
+
+  TableShard& ShardOf(int fileID) {
+    return Shards[(unsigned) fileID % Shards.size()];
+  }
+
+  /*
+    Returns the key of a file in the table of its shard
+  */
+  int KeyOf(int fileID) {
+    return (unsigned) fileID / Shards.size();
+  }
+
+  int HomeGroup(int fileID) {
+    return (unsigned) fileID % Groups.size();
+  }
+
+  BlockGroup& GroupOf(BlockIndex index) {
+    return Groups[min(index / group_size, (BlockIndex) Groups.size() - 1)];
+  }
+
+  /*
+    This function takes amount blocks off the total of free blocks and
+    returns true, or returns false without changing it if there are not
+    that many free blocks
+  */
+  bool TakeSpace(BlockIndex amount) {
+
+    BlockIndex free = available_space.load();
+
+    do {
+      if (free < amount) return false;
+    } while (!available_space.compare_exchange_weak(free, free - amount));
+
+    return true;
+  }
+
+  /*
+    Marks a run of free blocks of a locked group as owned by the given
+    file, index being the first block of the run on the directory
+  */
+  void Fill(BlockGroup& G, int fileID, BlockIndex index, BlockIndex length) {
+
+    for (BlockIndex i = index ; i < index + length ; ++i) {
+      Directory[i] = fileID;
+    }
+
+    G.FreeSpace.Reserve(index - G.start, length);
+    G.available_space -= length;
+  }
+
+  /*
+    Marks a run of blocks of a locked group as empty
+  */
+  void Empty(BlockGroup& G, BlockIndex index, BlockIndex length) {
+
+    for (BlockIndex i = index ; i < index + length ; ++i) {
+      Directory[i] = EMPTY;
+    }
+
+    G.FreeSpace.Release(index - G.start, length);
+    G.available_space += length;
+  }
+
+  /*
+    This function appends block_num blocks to the given extent list,
+    whose blocks the caller has already taken off available_space. Blocks
+    are taken from the home group of the file first, as few runs as
+    possible in every group, and from the following groups when it is
+    full. Groups may be visited more than once, since blocks taken off
+    available_space by other calls but not yet filled can make a group
+    look full for a moment
+  */
+  void Allocate(int fileID, vector<Extent>& List, BlockIndex logical, BlockIndex block_num) {
+
+    for (int k = HomeGroup(fileID) ; 0 < block_num ; k = (k + 1) % Groups.size()) {
+
+      BlockGroup& G = Groups[k];
+      lock_guard<mutex> Guard(G.Lock);
+
+      while (0 < block_num && 0 < G.available_space) {
+
+        BlockIndex length = block_num;
+        BlockIndex index = G.FreeSpace.FindFirstFit(length);
+
+        if (index == FAIL) {
+          length = G.FreeSpace.LargestExtent();
+          index = G.FreeSpace.FindFirstFit(length);
+        }
+
+        Fill(G, fileID, G.start + index, length);
+        List.push_back(Extent(logical, G.start + index, length));
+
+        logical += length;
+        block_num -= length;
+      }
+    }
+  }
+
+  /*
+    This function creates a new file.
+  */
+  int CreateFile(int fileID, long long file_length) {
+
+    TableShard& S = ShardOf(fileID);
+    lock_guard<mutex> Guard(S.Lock);
+
+    int key = KeyOf(fileID);
+
+    // if such file exists, the operation fails
+    if (S.Table.FileExists(key)) {
+      Logger.LogIssue("create_file", "Cannot create a file that already exists");
+      return FAIL;
+    }
+
+    BlockIndex block_num = ByteToBlock(file_length);
+
+    // if no available space, the operation is rejected
+    if (!TakeSpace(block_num)) {
+      Logger.LogInfo("CreateFile", "Creation Rejected due to insufficient space");
+      return REJECT;
+    }
+
+    vector<Extent>& List = S.Extents[key];
+
+    Allocate(fileID, List, 0, block_num);
+
+    BlockIndex index = List.empty() ? END_OF_FILE : List[0].physical;
+
+    // add file to Directory Table
+    return S.Table.AddFile(key, File(index, block_num, file_length));
+  }
+
+  /*
+    This function takes a file ID and a byte offset of that file, and
+    it returns the index of the block at which given offset of the
+    file is stored in the directory. The extent holding the offset is
+    found with a binary search over the extents of the file
+  */
+  BlockIndex Access(int fileID, long long byte_offset) {
+
+    TableShard& S = ShardOf(fileID);
+    lock_guard<mutex> Guard(S.Lock);
+
+    int key = KeyOf(fileID);
+    File* F = S.Table.Find(key);
+
+    // if such file does not exist, operation fails
+    if (F == NULL) {
+      Logger.LogInfo("Access", "Cannot access file that does not exist");
+      return FAIL;
+    }
+
+    // if byte offset is larger the file byte length, operation fails
+    if (F->byte_len < byte_offset) {
+      Logger.LogInfo("Access", "Byte offset to be accessed exceeds actual file size");
+      return FAIL;
+    }
+
+    BlockIndex logical = max(ByteToBlock(byte_offset) - 1, 0LL);
+
+    vector<Extent>& List = S.Extents[key];
+
+    if (List.empty()) {
+      return FAIL;
+    }
+
+    // find the last extent starting at or before the logical block
+    int lo = 0, hi = List.size() - 1;
+
+    while (lo < hi) {
+
+      int mid = (lo + hi + 1) / 2;
+
+      if (List[mid].logical <= logical) lo = mid;
+      else hi = mid - 1;
+    }
+
+    return List[lo].physical + logical - List[lo].logical;
+  }
+
+  /*
+    This function takes a file and an extension amount, and it
+    extends the desired file by the number of blocks equal to
+    the given amount. The last extent grows in place over the free
+    blocks that follow it in its group, and new extents are only
+    added for the remaining blocks
+  */
+  int Extend(int fileID, BlockIndex extension_amount) {
+
+    TableShard& S = ShardOf(fileID);
+    lock_guard<mutex> Guard(S.Lock);
+
+    int key = KeyOf(fileID);
+    File* F = S.Table.Find(key);
+
+    // if such file does not exist, operation fails
+    if (F == NULL) {
+      Logger.LogIssue("Extend", "Cannot extend file that does not exist");
+      return FAIL;
+    }
+
+    // if no available space of extension, reject
+    if (!TakeSpace(extension_amount)) {
+      Logger.LogInfo("Extend", "Extension Rejected due to insufficient space");
+      return REJECT;
+    }
+
+    vector<Extent>& List = S.Extents[key];
+    BlockIndex remaining = extension_amount;
+
+    if (!List.empty()) {
+
+      Extent& Last = List.back();
+      BlockGroup& G = GroupOf(Last.physical);
+      lock_guard<mutex> GroupGuard(G.Lock);
+
+      // count the free blocks of the group that directly follow the last extent
+      BlockIndex end = Last.physical + Last.length - G.start;
+      BlockIndex used = G.FreeSpace.Bits.FindNextUsed(end);
+      BlockIndex room = end < G.block_count ? (used == FAIL ? G.block_count : used) - end : 0;
+      BlockIndex grow = min(room, remaining);
+
+      Fill(G, fileID, G.start + end, grow);
+      Last.length += grow;
+      remaining -= grow;
+    }
+
+    Allocate(fileID, List, F->block_len + extension_amount - remaining, remaining);
+
+    if (F->index == END_OF_FILE && !List.empty()) F->index = List[0].physical;
+
+    // update lengths in Directory table
+    F->block_len += extension_amount;
+    F->byte_len += block_size * extension_amount;
+
+    return SUCCESS;
+  }
+
+  /*
+    This function shrinks a file by a given amount, releasing blocks
+    from the end of its last extents
+  */
+  int Shrink(int fileID, BlockIndex shrink_amount) {
+
+    TableShard& S = ShardOf(fileID);
+    lock_guard<mutex> Guard(S.Lock);
+
+    int key = KeyOf(fileID);
+    File* F = S.Table.Find(key);
+
+    // if such file does not exist, operation fails
+    if (F == NULL) {
+      Logger.LogIssue("Shrink", "Cannot shrink file that does not exist");
+      return FAIL;
+    }
+
+    // shrink amount cannot exceed current length
+    if (F->block_len <= shrink_amount) {
+      Logger.LogIssue("Shrink", "Shrink aborted because shrink amount is greater than file size");
+      return FAIL;
+    }
+
+    vector<Extent>& List = S.Extents[key];
+
+    for (BlockIndex remaining = shrink_amount ; 0 < remaining ; ) {
+
+      Extent& Last = List.back();
+      BlockIndex cut = min(Last.length, remaining);
+
+      BlockGroup& G = GroupOf(Last.physical);
+
+      {
+        lock_guard<mutex> GroupGuard(G.Lock);
+        Empty(G, Last.physical + Last.length - cut, cut);
+      }
+
+      Last.length -= cut;
+      remaining -= cut;
+
+      if (Last.length == 0) List.pop_back();
+    }
+
+    // update lengths in Directory table
+    F->block_len -= shrink_amount;
+    F->byte_len -= block_size * shrink_amount;
+
+    // the blocks can only be taken again once they are free in their group
+    available_space += shrink_amount;
+
+    return SUCCESS;
+  }
+
+  /*
+    Free runs are counted group by group, so a run that spans the end of
+    a group and the start of the next is counted as two. Groups are
+    locked one at a time, so the gauges are only exact when no call is
+    running
+  */
+  SpaceMetrics FreeMetrics() {
+
+    SpaceMetrics M;
+    BlockIndex runs = 0, largest = 0, free = 0;
+
+    for (BlockGroup& G : Groups) {
+
+      lock_guard<mutex> Guard(G.Lock);
+
+      runs += G.FreeSpace.ExtentCount();
+      largest = max(largest, G.FreeSpace.LargestExtent());
+      free += G.available_space;
+    }
+
+    M.SetFree(runs, largest, free);
+
+    return M;
+  }
+
+  SpaceMetrics Metrics() {
+
+    SpaceMetrics M = FreeMetrics();
+
+    long long bytes = 0;
+    BlockIndex blocks = 0, runs = 0;
+
+    for (TableShard& S : Shards) {
+
+      lock_guard<mutex> Guard(S.Lock);
+
+      S.Table.ForEach([&](int, File& F) {
+        bytes += F.byte_len;
+        blocks += F.block_len;
+      });
+
+      for (auto& el : S.Extents) runs += el.second.size();
+    }
+
+    M.internal_fragmentation = (block_count - M.free_blocks) * block_size - bytes;
+    M.average_run_length = runs == 0 ? 0.0 : (double) blocks / runs;
+
+    return M;
+  }
+
+  /*
+    Returns a copy of the files of every shard as a map from file ID to
+    metadata. Shards are locked one at a time, so the copy is only a
+    single state of the directory when no call is running
+  */
+  unordered_map<int, File> ViewTable() {
+
+    unordered_map<int, File> Res;
+
+    for (int s = 0 ; s < (int) Shards.size() ; ++s) {
+
+      lock_guard<mutex> Guard(Shards[s].Lock);
+
+      Shards[s].Table.ForEach([&](int key, File& F) { Res[(unsigned) key * Shards.size() + s] = F; });
+    }
+
+    return Res;
+  }
+
+  /*
+    Returns the average number of extents of the files in the directory
+  */
+  double ExtentsPerFile() {
+
+    double total = 0.0, files = 0.0;
+
+    for (TableShard& S : Shards) {
+
+      lock_guard<mutex> Guard(S.Lock);
+
+      for (auto& el : S.Extents) total += el.second.size();
+
+      files += S.Extents.size();
+    }
+
+    return files == 0 ? 0.0 : total / files;
+  }
+};
@@ -1,8 +1,1060 @@
 #include "file_data_structures.h"
+#include "trace.h"
+#include "snapshot.h"
+#include "concurrent_allocation.h"
+#include <random>
 
+/*
+	Returns the first run of length free blocks at or after pos, found by
+	checking every block, or FAIL if there is none
+*/
+BlockIndex NaiveFind(vector<bool>& Free, BlockIndex pos, BlockIndex length) {
+
+	for (BlockIndex i = pos ; i + length <= (BlockIndex) Free.size() ; ++i) {
+
+		BlockIndex j = i;
+
+		while (j < i + length && Free[j]) j++;
+
+		if (j == i + length) return i;
+	}
+
+	return FAIL;
+}
+
+/*
+	Counts the maximal runs of free blocks and the longest of them by
+	checking every block
+*/
+void NaiveRuns(vector<bool>& Free, BlockIndex& runs, BlockIndex& largest) {
+
+	runs = largest = 0;
+
+	for (BlockIndex i = 0, run = 0 ; i < (BlockIndex) Free.size() ; ++i) {
+
+		run = Free[i] ? run + 1 : 0;
+
+		if (run == 1) runs++;
+
+		largest = max(largest, run);
+	}
+}
+
+/*
+	Checks that files with no blocks, whose index is END_OF_FILE, are kept
+	by DirectoryTable like any other file, with dense and sparse IDs, and
+	that the strategies that create them find them again and extend them
+*/
+void TestDirectoryTable() {
+
+	DirectoryTable Table;
+
+	assert(Table.AddFile(1, File(END_OF_FILE, 0, 0)) == SUCCESS);
+	assert(Table.AddFile(-3, File(END_OF_FILE, 0, 0)) == SUCCESS);
+	assert(Table.FileExists(1) && Table.FileExists(-3) && !Table.FileExists(0) && !Table.FileExists(2));
+	assert(Table.AddFile(1, File(5, 1, 8)) == FAIL && Table.size() == 2 && Table.ToMap().size() == 2);
+
+	assert(Table.RemoveFile(1) == SUCCESS && !Table.FileExists(1) && Table.size() == 1);
+	assert(Table.AddFile(1, File(5, 1, 8)) == SUCCESS && Table.Find(1)->index == 5);
+
+	ExtentAllocation EA(8, 16);
+
+	assert(EA.CreateFile(1, 0) == SUCCESS && EA.CreateFile(1, 8) == FAIL && EA.Table.size() == 1);
+	assert(EA.Access(1, 0) == FAIL);
+	assert(EA.CreateFile(2, 16) == SUCCESS && EA.Extend(1, 2) == SUCCESS);
+	assert(EA.Table.Find(1)->index == 2 && EA.Access(1, 9) == 3);
+
+	BuddyAllocation BA(8, 16);
+
+	assert(BA.CreateFile(1, 0) == SUCCESS && BA.CreateFile(1, 8) == FAIL && BA.Table.size() == 1);
+	assert(BA.Access(1, 0) == FAIL);
+	assert(BA.CreateFile(2, 16) == SUCCESS && BA.Extend(1, 2) == SUCCESS);
+	assert(BA.Table.Find(1)->index == 2 && BA.Access(1, 9) == 3);
+}
+
+/*
+	Checks the summaries of FreeExtentTree on known layouts, with runs
+	inside one word, across words and at both ends, and then checks its
+	searches and summaries against a scan of the blocks while random
+	ranges are reserved and released
+*/
+void TestFreeExtentTree() {
+
+	FreeExtentTree T(128);
+
+	T.Reserve(10, 110);
+
+	assert(T.Nodes[1].pre == 10 && T.Nodes[1].suf == 8);
+	assert(T.LargestExtent() == 10 && T.ExtentCount() == 2);
+
+	T.Release(50, 30);
+
+	assert(T.LargestExtent() == 30 && T.ExtentCount() == 3);
+	assert(T.FindFirstFit(11) == 50 && T.FindFirstFit(30) == 50 && T.FindFirstFit(31) == FAIL);
+	assert(T.FindFrom(51, 8) == 51 && T.FindFrom(75, 8) == 120 && T.FindFrom(121, 8) == FAIL);
+
+	T.Release(10, 40);
+
+	assert(T.Nodes[1].pre == 80 && T.LargestExtent() == 80 && T.ExtentCount() == 2);
+
+	srand(1);
+
+	for (BlockIndex block_count : {1, 63, 64, 65, 200, 4096}) {
+
+		FreeExtentTree Tree(block_count);
+		vector<bool> Free(block_count, true);
+
+		for (int it = 0 ; it < 2000 ; ++it) {
+
+			BlockIndex index = rand() % block_count;
+			BlockIndex length = 1 + rand() % (block_count - index);
+			bool free = rand() % 2;
+
+			Tree.SetRange(index, length, free);
+
+			for (BlockIndex i = index ; i < index + length ; ++i) Free[i] = free;
+
+			BlockIndex runs, largest;
+			NaiveRuns(Free, runs, largest);
+
+			assert(Tree.LargestExtent() == largest);
+			assert(Tree.ExtentCount() == runs);
+
+			BlockIndex pos = rand() % block_count, want = 1 + rand() % 16;
+
+			assert(Tree.FindFrom(pos, want) == NaiveFind(Free, pos, want));
+			assert(Tree.FindFirstFit(want) == NaiveFind(Free, 0, want));
+		}
+	}
+}
+
+/*
+	Checks the scans of FreeBitmap against a scan of the blocks, on bitmaps
+	with long stretches of full and empty words so that whole words are
+	skipped in vector registers, and sizes that do not end on a word
+*/
+void TestFreeBitmap() {
+
+	srand(2);
+
+	for (BlockIndex block_count : {1, 64, 100, 1000, 64 * 1000 + 17}) {
+
+		FreeBitmap Bits(block_count);
+		vector<bool> Free(block_count, true);
+
+		// stretches of random length, each all used, all free or mixed
+		for (BlockIndex i = 0 ; i < block_count ; ) {
+
+			BlockIndex length = min((BlockIndex) (1 + rand() % 2000), block_count - i);
+			int kind = rand() % 3;
+
+			for (BlockIndex j = i ; j < i + length ; ++j) {
+				Free[j] = kind == 0 || (kind == 2 && rand() % 4 == 0);
+				Bits.Set(j, Free[j]);
+			}
+
+			i += length;
+		}
+
+		for (BlockIndex i = 0 ; i < block_count ; ++i) assert(Bits.IsFree(i) == Free[i]);
+
+		// the next free and the next used block after every block
+		BlockIndex next_free = FAIL, next_used = FAIL;
+
+		for (BlockIndex i = block_count - 1 ; 0 <= i ; --i) {
+
+			if (Free[i]) next_free = i; else next_used = i;
+
+			assert(Bits.FindNextFree(i) == next_free);
+			assert(Bits.FindNextUsed(i) == next_used);
+		}
+
+		for (BlockIndex w = 0 ; w < Bits.word_count ; ++w) {
+
+			BlockIndex full = w, empty = w;
+
+			while (full < Bits.word_count && Bits.Words[full] == 0) full++;
+			while (empty < Bits.word_count && Bits.Words[empty] == ~0ULL) empty++;
+
+			assert(Bits.SkipFull(w) == full);
+			assert(Bits.SkipWords(w, ~0ULL) == empty);
+		}
+
+		BlockIndex runs, largest, naive_runs, naive_largest;
+
+		Bits.RunStats(runs, largest);
+		NaiveRuns(Free, naive_runs, naive_largest);
+
+		assert(runs == naive_runs && largest == naive_largest);
+
+		vector<BlockIndex> All;
+
+		for (BlockIndex i = 0 ; i < block_count ; ++i) {
+			if (Free[i]) All.push_back(i);
+		}
+
+		for (int it = 0 ; it < 50 ; ++it) {
+
+			BlockIndex count = rand() % (All.size() + 2);
+			BlockIndex from = rand() % block_count, to = from + rand() % (block_count - from + 1);
+
+			vector<BlockIndex> Res, Range, Naive;
+
+			Bits.Collect(count, Res);
+			Bits.CollectRange(from, to, count, Range);
+
+			assert(Res == vector<BlockIndex>(All.begin(), All.begin() + min(count, (BlockIndex) All.size())));
+
+			for (BlockIndex x : All) {
+				if (from <= x && x < to && (BlockIndex) Naive.size() < count) Naive.push_back(x);
+			}
+
+			assert(Range == Naive);
+		}
+	}
+}
+
+/*
+	Checks that every data block of every file, found through Access, is
+	owned by that file in the directory and by no other file, and that as
+	many blocks are owned as are not available
+*/
+template<typename Strategy>
+void CheckBlocks(Strategy& A) {
+
+	vector<bool> Seen(A.block_count, false);
+
+	for (auto& el : A.ViewTable()) {
+
+		for (BlockIndex logical = 0 ; logical < el.second.block_len ; ++logical) {
+
+			BlockIndex index = A.Access(el.first, logical * A.block_size + 1);
+
+			assert(0 <= index && index < A.block_count && A.Directory[index] == el.first);
+			assert(!Seen[index]);
+
+			Seen[index] = true;
+		}
+	}
+
+	BlockIndex taken = 0;
+
+	for (BlockIndex i = 0 ; i < A.block_count ; ++i) taken += A.Directory[i] != EMPTY;
+
+	assert(taken == A.block_count - A.available_space);
+}
+
+/*
+	Applies random calls on files 1 to files, creating a file of at most
+	max_blocks blocks if it does not exist and extending or shrinking it
+	otherwise, and runs Check after every call. Only calls that may
+	succeed are made, rejections aside
+*/
+template<typename Strategy, typename Checker>
+void RandomCalls(Strategy& A, int calls, int files, BlockIndex max_blocks, Checker Check) {
+
+	for (int it = 0 ; it < calls ; ++it) {
+
+		int fileID = 1 + rand() % files;
+		unordered_map<int, File> Files = A.ViewTable();
+		auto F = Files.find(fileID);
+
+		if (F == Files.end()) {
+			A.CreateFile(fileID, 1 + rand() % (max_blocks * A.block_size));
+		} else if (rand() % 2) {
+			A.Extend(fileID, 1 + rand() % max_blocks);
+		} else if (1 < F->second.block_len) {
+			A.Shrink(fileID, 1 + rand() % (F->second.block_len - 1));
+		}
+
+		Check();
+	}
+}
+
+/*
+	Checks the layout of IndexedAllocation on a small directory, where an
+	index block holds four pointers: two direct ones, the single indirect
+	one and the double indirect one, and on blocks of 8 bytes, which leave
+	no direct pointer. Then checks that random calls keep every file
+	owning its data blocks and exactly the index blocks its length needs,
+	each with a slot of the slab of pointers
+*/
+void TestIndexedAllocation() {
+
+	IndexedAllocation IA(16, 64);
+
+	assert(IA.direct_count == 2 && IA.MaxFileBlocks() == 22);
+
+	// index block, two direct blocks, the single indirect block and
+	// the data block it points to
+	assert(IA.CreateFile(1, 48) == SUCCESS);
+	assert(IA.Slice(0, 6) == vector<int>({1, 1, 1, 1, 1, 0}));
+	assert(IA.Access(1, 0) == 1 && IA.Access(1, 17) == 2 && IA.Access(1, 33) == 4);
+	assert(IA.PointersOf(0)[2] == 3 && IA.available_space == 59);
+
+	// two more blocks through the single indirect block, then the double
+	// indirect block, a single indirect block under it and a data block
+	assert(IA.Extend(1, 4) == SUCCESS);
+	assert(IA.Access(1, 49) == 5 && IA.Access(1, 81) == 7 && IA.Access(1, 97) == 10);
+	assert(IA.PointersOf(0)[3] == 8 && IA.PointersOf(8)[0] == 9 && IA.available_space == 53);
+
+	assert(IA.Shrink(1, 4) == SUCCESS);
+	assert(IA.Slice(0, 11) == vector<int>({1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0}));
+	assert(IA.available_space == 59 && IA.FreeBlocks.FindNextFree(0) == 5);
+
+	assert(IA.CreateFile(2, 23 * 16) == REJECT);
+	assert(IA.Extend(1, 20) == REJECT);
+
+	// every block of a file goes through the single indirect block
+	IndexedAllocation Small(8, 64);
+
+	assert(Small.direct_count == 0 && Small.CreateFile(1, 0) == SUCCESS);
+	assert(Small.Access(1, 0) == FAIL && Small.available_space == 63);
+	assert(Small.CreateFile(2, 8) == SUCCESS && Small.Access(2, 1) == 3);
+	assert(Small.Extend(1, 1) == SUCCESS && Small.Access(1, 1) == 5 && Small.PointersOf(0)[0] == 4);
+	assert(Small.Shrink(2, 1) == FAIL && Small.Slab.size() == 4 * 2);
+
+	srand(3);
+
+	for (int block_size : {16, 8}) {
+
+		IndexedAllocation Random(block_size, 2048);
+
+		RandomCalls(Random, 5000, 40, 22, [&]() {
+
+			CheckBlocks(Random);
+
+			map<int, BlockIndex> Owned;
+			BlockIndex index_blocks = 0;
+
+			for (BlockIndex i = 0 ; i < Random.block_count ; ++i) {
+				if (Random.Directory[i] != EMPTY) Owned[Random.Directory[i]]++;
+			}
+
+			for (auto& el : Random.ViewTable()) {
+				assert(Owned[el.first] == el.second.block_len + Random.IndexBlockCount(el.second.block_len));
+				index_blocks += Random.IndexBlockCount(el.second.block_len);
+			}
+
+			// every index block has a slot of its own, every other slot is free
+			set<BlockIndex> Slots(Random.FreeSlots.begin(), Random.FreeSlots.end());
+
+			for (BlockIndex i = 0 ; i < Random.block_count ; ++i) {
+				if (Random.SlotOf[i] != 0) Slots.insert(Random.SlotOf[i] - 1);
+			}
+
+			assert((BlockIndex) Slots.size() == index_blocks + (BlockIndex) Random.FreeSlots.size());
+			assert((BlockIndex) Slots.size() * Random.pointers_per_block == (BlockIndex) Random.Slab.size());
+		});
+	}
+}
+
+/*
+	Returns whether the extents of a file are as given, each as a
+	(logical, physical, length) triple
+*/
+bool SameExtents(vector<Extent>& List, vector<vector<BlockIndex>> Expected) {
+
+	if (List.size() != Expected.size()) return false;
+
+	for (int i = 0 ; i < (int) List.size() ; ++i) {
+
+		if (List[i].logical != Expected[i][0] || List[i].physical != Expected[i][1] || List[i].length != Expected[i][2]) return false;
+	}
+
+	return true;
+}
+
+/*
+	Checks ExtentAllocation on a known layout: growing the last extent in
+	place, adding an extent when the next block is taken, splitting a file
+	over the largest runs when no run is long enough, and shrinking across
+	extents. Then checks that random calls keep the extents of every file
+	covering it in logical order
+*/
+void TestExtentAllocation() {
+
+	ExtentAllocation EA(8, 32);
+
+	assert(EA.CreateFile(1, 32) == SUCCESS && EA.CreateFile(2, 32) == SUCCESS);
+	assert(EA.Extend(1, 2) == SUCCESS);
+	assert(SameExtents(EA.Extents[1], {{0, 0, 4}, {4, 8, 2}}));
+	assert(EA.Access(1, 33) == 8);
+
+	assert(EA.Extend(1, 3) == SUCCESS);
+	assert(SameExtents(EA.Extents[1], {{0, 0, 4}, {4, 8, 5}}));
+	assert(EA.Access(1, 65) == 12);
+
+	// free runs are [5, 8) and [13, 32)
+	assert(EA.Shrink(2, 3) == SUCCESS);
+	assert(EA.CreateFile(3, 20 * 8) == SUCCESS);
+	assert(SameExtents(EA.Extents[3], {{0, 13, 19}, {19, 5, 1}}));
+	assert(EA.Access(3, 19 * 8 + 1) == 5 && EA.available_space == 2);
+
+	assert(EA.Shrink(1, 6) == SUCCESS);
+	assert(SameExtents(EA.Extents[1], {{0, 0, 3}}));
+	assert(EA.Slice(0, 14) == vector<int>({1, 1, 1, 0, 2, 3, 0, 0, 0, 0, 0, 0, 0, 3}));
+	assert(EA.available_space == 8 && EA.FreeSpace.ExtentCount() == 2);
+
+	assert(EA.CreateFile(4, 9 * 8) == REJECT);
+
+	srand(4);
+
+	ExtentAllocation Random(8, 2048);
+
+	RandomCalls(Random, 5000, 40, 64, [&]() {
+
+		CheckBlocks(Random);
+
+		for (auto& el : Random.ViewTable()) {
+
+			BlockIndex logical = 0;
+
+			for (Extent& E : Random.Extents[el.first]) {
+				assert(E.logical == logical && 0 < E.length);
+				logical += E.length;
+			}
+
+			assert(logical == el.second.block_len);
+		}
+	});
+}
+
+/*
+	Returns the blocks of a linked file in chain order
+*/
+vector<BlockIndex> Chain(LinkedAllocation& A, File& F) {
+
+	vector<BlockIndex> Res;
+
+	for (BlockIndex index = F.index ; index != END_OF_FILE ; index = A.Directory[index].next) {
+		Res.push_back(index);
+	}
+
+	return Res;
+}
+
+/*
+	Checks that random calls on LinkedAllocation, with and without goal
+	placement, keep the tail of every file in the directory table on the
+	last block of its chain, and the chain as long as the file
+*/
+void TestLinkedTail() {
+
+	srand(6);
+
+	for (BlockIndex group_size : {0, 64}) {
+
+		LinkedAllocation A(16, 2048, 0, group_size);
+
+		RandomCalls(A, 5000, 40, 64, [&]() {
+
+			for (auto& el : A.ViewTable()) {
+
+				vector<BlockIndex> Blocks = Chain(A, el.second);
+
+				assert((BlockIndex) Blocks.size() == el.second.block_len);
+				assert(Blocks.back() == el.second.tail);
+			}
+		});
+	}
+}
+
+/*
+	Checks that random calls on LinkedAllocation keep the jump index of
+	every file pointing at every jump_interval-th block of its chain, and
+	that Access through the jump index finds the same block as following
+	the chain, for every block of every file. Access on a file missing
+	from the jump index falls back to following the chain
+*/
+void TestLinkedJumps() {
+
+	srand(7);
+
+	LinkedAllocation A(16, 2048, 4), Plain(16, 2048);
+
+	for (int it = 0 ; it < 3000 ; ++it) {
+
+		// the same random calls on both, they place blocks the same way
+		unsigned seed = rand();
+
+		srand(seed);
+		RandomCalls(A, 1, 40, 64, []() {});
+		srand(seed);
+		RandomCalls(Plain, 1, 40, 64, []() {});
+
+		if (it % 100 != 0) continue;
+
+		for (auto& el : A.ViewTable()) {
+
+			vector<BlockIndex> Blocks = Chain(A, el.second);
+			vector<BlockIndex>& Jumps = A.Jumps[el.first];
+
+			assert((BlockIndex) Jumps.size() == (el.second.block_len + 3) / 4);
+
+			for (int i = 0 ; i < (int) Jumps.size() ; ++i) assert(Jumps[i] == Blocks[4 * i]);
+
+			for (BlockIndex logical = 0 ; logical < el.second.block_len ; ++logical) {
+
+				long long offset = logical * A.block_size + 1;
+
+				assert(A.Access(el.first, offset) == Blocks[logical]);
+				assert(Plain.Access(el.first, offset) == Blocks[logical]);
+			}
+		}
+	}
+
+	assert(0 < A.JumpIndexBytes() && Plain.JumpIndexBytes() == 0);
+
+	int fileID = A.ViewTable().begin()->first;
+	File& F = *A.Table.Find(fileID);
+
+	A.Jumps.erase(fileID);
+
+	assert(A.Access(fileID, F.byte_len) == Chain(A, F).back());
+	assert(A.Jumps.count(fileID) == 0);
+}
+
+/*
+	Returns whether two buffers hold the same calls
+*/
+bool SameOps(OpBuffer& A, OpBuffer& B) {
+
+	return A.Codes == B.Codes && A.Arg1 == B.Arg1 && A.Arg2 == B.Arg2;
+}
+
+/*
+	Checks that a text trace decodes to the expected calls, and that its
+	binary conversion decodes to the same calls with the right header.
+	Then does the same for every input trace found under io. A trace with
+	a record that cannot be recognized fails to convert and leaves no file
+	behind, and a binary trace cut short fails to open
+*/
+void TestTraceRoundTrip() {
+
+	string text = "test_trace.txt", binary = "test_trace.bin";
+
+	FILE* out = fopen(text.c_str(), "w");
+	fputs("c:436245\na:0:48\r\ne:0:83\n\nsh:0:2\nc:72057594037927935", out);
+	fclose(out);
+
+	OpBuffer Text, Binary;
+
+	assert(Text.Load(text) == SUCCESS);
+	assert(Text.Codes == vector<unsigned char>({OP_CREATE, OP_ACCESS, OP_EXTEND, OP_SHRINK, OP_CREATE}));
+	assert(Text.Arg1 == vector<long long>({436245, 0, 0, 0, 72057594037927935LL}));
+	assert(Text.Arg2 == vector<long long>({0, 48, 83, 2, 0}));
+
+	assert(ConvertTrace(text, binary, 1024) == SUCCESS);
+	assert(Binary.Load(binary) == SUCCESS);
+	assert(SameOps(Text, Binary) && Binary.block_size == 1024);
+
+	TraceReader Reader;
+
+	assert(Reader.Open(binary) == SUCCESS && Reader.binary);
+	assert(Reader.Header.op_count == 5 && Reader.Header.counts[OP_CREATE] == 2 && Reader.Header.counts[OP_SHRINK] == 1);
+
+	Reader.Close();
+
+	// cut the last record short
+	assert(truncate(binary.c_str(), sizeof(TraceHeader) + 4 * sizeof(TraceRecord) + 3) == 0);
+	assert(Reader.Open(binary) == FAIL);
+
+	out = fopen(text.c_str(), "w");
+	fputs("c:10\nx:1:2\n", out);
+	fclose(out);
+
+	assert(ConvertTrace(text, binary, 8) == FAIL);
+	assert(access(binary.c_str(), F_OK) != 0);
+
+	for (string path : {"io/input_8_600_5_5_0.txt", "io/input_1024_200_5_9_9.txt", "io/input_2048_600_5_5_0.txt"}) {
+
+		if (Text.Load(path) == FAIL) continue;
+
+		assert(ConvertTrace(path, binary, 8) == SUCCESS);
+		assert(Binary.Load(binary) == SUCCESS && SameOps(Text, Binary));
+	}
+
+	remove(text.c_str());
+	remove(binary.c_str());
+}
+
+/*
+	Checks BuddyAllocation on known layouts: splitting a run down to the
+	order requested, filling the last run of a file before taking a new
+	one, giving back the upper halves of the last run on shrinking and
+	merging a released run with its free buddy. Then checks under random
+	calls that runs are aligned powers of two covering every file, and
+	that the free lists hold aligned empty runs with no free buddies left
+	unmerged, as many blocks as are available
+*/
+void TestBuddyAllocation() {
+
+	BuddyAllocation BA(8, 16);
+
+	assert(BA.CreateFile(1, 24) == SUCCESS);
+	// gcc 12 at -O2 -march=native builds the initializer list
+	// {1, 1, 1, 1, 0, 0, 0, 0} as eight ones, so it is checked in halves
+	assert(BA.Slice(0, 4) == vector<int>(4, 1) && BA.Slice(4, 8) == vector<int>(4, EMPTY));
+	assert(BA.Heads[3] == 8 && BA.Heads[2] == 4 && BA.available_space == 12);
+
+	assert(BA.CreateFile(2, 8) == SUCCESS);
+	assert(BA.Access(2, 1) == 4 && BA.Heads[1] == 6 && BA.Heads[0] == 5);
+
+	// the unused block of the first run is used before a new run is taken
+	assert(BA.Extend(1, 1) == SUCCESS && BA.Access(1, 25) == 3 && BA.available_space == 11);
+	assert(BA.Extend(1, 2) == SUCCESS && BA.Access(1, 33) == 6 && BA.available_space == 9);
+
+	assert(BA.Shrink(1, 5) == SUCCESS);
+	assert(BA.Runs[1].size() == 1 && BA.Runs[1][0].length == 1);
+	assert(BA.Slice(0, 8) == vector<int>({1, 0, 0, 0, 2, 0, 0, 0}));
+	assert(BA.FreeOrder[1] == 1 && BA.FreeOrder[2] == 2 && BA.FreeOrder[6] == 2 && BA.available_space == 14);
+
+	// blocks 2 and 3 are taken as two runs of one block, and merge back
+	BuddyAllocation Merge(8, 16);
+
+	assert(Merge.CreateFile(1, 8) == SUCCESS && Merge.CreateFile(2, 8) == SUCCESS);
+	assert(Merge.Extend(2, 1) == SUCCESS && Merge.Access(2, 9) == 2);
+	assert(Merge.Shrink(2, 1) == SUCCESS);
+	assert(Merge.FreeOrder[2] == 2 && Merge.FreeOrder[3] == 0 && Merge.Heads[0] == END_OF_FILE);
+
+	srand(18);
+
+	BuddyAllocation Random(8, 1000);
+
+	RandomCalls(Random, 5000, 40, 64, [&]() {
+
+		CheckBlocks(Random);
+
+		for (auto& el : Random.ViewTable()) {
+
+			BlockIndex logical = 0;
+
+			for (Extent& Run : Random.Runs[el.first]) {
+				assert(Run.logical == logical && __builtin_popcountll(Run.length) == 1 && Run.physical % Run.length == 0);
+				logical += Run.length;
+			}
+
+			assert(el.second.block_len <= logical);
+		}
+
+		BlockIndex free = 0;
+
+		for (int k = 0 ; k <= Random.max_order ; ++k) {
+
+			for (BlockIndex index = Random.Heads[k] ; index != END_OF_FILE ; index = Random.Next[index]) {
+
+				BlockIndex buddy = index ^ (1LL << k);
+
+				assert(index % (1LL << k) == 0 && Random.FreeOrder[index] == k + 1);
+				assert(k == Random.max_order || Random.block_count < buddy + (1LL << k) || Random.FreeOrder[buddy] != k + 1);
+
+				for (BlockIndex i = index ; i < index + (1LL << k) ; ++i) assert(Random.Directory[i] == EMPTY);
+
+				free += 1LL << k;
+			}
+		}
+
+		assert(free == Random.available_space);
+	});
+}
+
+/*
+	Leaves free runs of 3, 2 and 5 blocks at 1, 7 and 11 of a directory
+	of 16 blocks, the rover of NextFit being at 11 when it is done
+*/
+template<typename Placement>
+void Holes(ContiguousAllocationT<Placement>& A) {
+
+	assert(A.CreateFile(1, 32) == SUCCESS && A.CreateFile(2, 16) == SUCCESS);
+	assert(A.CreateFile(3, 24) == SUCCESS && A.CreateFile(4, 16) == SUCCESS);
+	assert(A.Shrink(1, 3) == SUCCESS && A.Shrink(3, 2) == SUCCESS);
+	assert(A.Slice(0, 12) == vector<int>({1, 0, 0, 0, 2, 2, 3, 0, 0, 4, 4, 0}));
+}
+
+/*
+	Applies random calls to a contiguous directory with the given policy
+	and checks after every one that the policy chooses for many lengths
+	the same block as Expected does from a scan of the blocks. The policy
+	is restored after every search, so that the rover of NextFit only
+	moves when files are placed
+*/
+template<typename Placement, typename Naive>
+void RandomPlacement(Naive Expected) {
+
+	ContiguousAllocationT<Placement> A(8, 512);
+
+	RandomCalls(A, 2000, 40, 32, [&]() {
+
+		vector<bool> Free(A.block_count);
+
+		for (BlockIndex i = 0 ; i < A.block_count ; ++i) Free[i] = A.Directory[i] == EMPTY;
+
+		for (BlockIndex length = 1 ; length <= 40 ; ++length) {
+
+			Placement Saved = A.Policy;
+			BlockIndex index = Expected(A, Free, length);
+
+			assert(A.FindAvailableSpace(length) == index);
+
+			A.Policy = Saved;
+		}
+	});
+}
+
+/*
+	Returns the first block of the maximal run of free blocks chosen by
+	Better among those of at least length blocks, where Better tells
+	whether a run of the first length is preferred to one of the second,
+	or FAIL if no run is long enough. Earlier runs win ties
+*/
+template<typename Compare>
+BlockIndex NaiveRun(vector<bool>& Free, BlockIndex length, Compare Better) {
+
+	BlockIndex chosen = FAIL, chosen_length = 0;
+
+	for (BlockIndex i = 0 ; i < (BlockIndex) Free.size() ; ) {
+
+		if (!Free[i]) {
+			i++;
+			continue;
+		}
+
+		BlockIndex j = i;
+
+		while (j < (BlockIndex) Free.size() && Free[j]) j++;
+
+		if (length <= j - i && (chosen == FAIL || Better(j - i, chosen_length))) {
+			chosen = i;
+			chosen_length = j - i;
+		}
+
+		i = j;
+	}
+
+	return chosen;
+}
+
+/*
+	Checks every placement policy on free runs of known lengths, then
+	against a scan of the blocks while random calls are made
+*/
+void TestPlacementPolicies() {
+
+	ContiguousAllocationT<FirstFit> First(8, 16);
+
+	Holes(First);
+
+	assert(First.FindAvailableSpace(2) == 1 && First.FindAvailableSpace(4) == 11);
+	assert(First.FindAvailableSpace(6) == FAIL);
+
+	// the rover moves past every file placed and wraps around
+	ContiguousAllocationT<NextFit> Next(8, 16);
+
+	Holes(Next);
+
+	assert(Next.FindAvailableSpace(2) == 11 && Next.FindAvailableSpace(3) == 13);
+	assert(Next.FindAvailableSpace(3) == 1 && Next.FindAvailableSpace(2) == 7);
+
+	ContiguousAllocationT<BestFit> Best(8, 16);
+
+	Holes(Best);
+
+	assert(Best.FindAvailableSpace(1) == 7 && Best.FindAvailableSpace(3) == 1);
+	assert(Best.FindAvailableSpace(4) == 11 && Best.FindAvailableSpace(6) == FAIL);
+
+	ContiguousAllocationT<WorstFit> Worst(8, 16);
+
+	Holes(Worst);
+
+	assert(Worst.FindAvailableSpace(1) == 11 && Worst.FindAvailableSpace(6) == FAIL);
+
+	// after placing a file there, the runs of 3 blocks at 1 and 13 tie
+	assert(Worst.CreateFile(5, 16) == SUCCESS && Worst.FindAvailableSpace(1) == 1);
+
+	srand(19);
+
+	RandomPlacement<FirstFit>([](ContiguousAllocationT<FirstFit>&, vector<bool>& Free, BlockIndex length) {
+		return NaiveFind(Free, 0, length);
+	});
+
+	RandomPlacement<NextFit>([](ContiguousAllocationT<NextFit>& A, vector<bool>& Free, BlockIndex length) {
+		BlockIndex index = NaiveFind(Free, A.Policy.rover, length);
+		return index == FAIL ? NaiveFind(Free, 0, length) : index;
+	});
+
+	RandomPlacement<BestFit>([](ContiguousAllocationT<BestFit>&, vector<bool>& Free, BlockIndex length) {
+		return NaiveRun(Free, length, [](BlockIndex a, BlockIndex b) { return a < b; });
+	});
+
+	RandomPlacement<WorstFit>([](ContiguousAllocationT<WorstFit>&, vector<bool>& Free, BlockIndex length) {
+		return NaiveRun(Free, length, [](BlockIndex a, BlockIndex b) { return a > b; });
+	});
+}
+
+/*
+	Checks that every group of a ConcurrentAllocation counts as free the
+	blocks that are empty in Directory, that its free space index agrees
+	with them, and that the groups add up to available_space
+*/
+void CheckGroups(ConcurrentAllocation& A) {
+
+	BlockIndex total = 0;
+
+	for (BlockGroup& G : A.Groups) {
+
+		BlockIndex free = 0;
+
+		for (BlockIndex i = 0 ; i < G.block_count ; ++i) {
+
+			bool empty = A.Directory[G.start + i] == EMPTY;
+
+			assert(G.FreeSpace.Bits.IsFree(i) == empty);
+			free += empty;
+		}
+
+		assert(free == G.available_space);
+		total += free;
+	}
+
+	assert(total == A.available_space);
+}
+
+/*
+	Checks ConcurrentAllocation on one thread: a file of no bytes that
+	takes its first blocks from its home group, and random calls that
+	keep files owning their blocks and the groups in agreement with the
+	directory. Then several threads make random calls on files of their
+	own, spread over every shard and group, and once they are done the
+	same checks must hold and every file must have the length its thread
+	gave it
+*/
+void TestConcurrentAllocation() {
+
+	ConcurrentAllocation CA(8, 1024, 8, 4);
+
+	assert(CA.CreateFile(1, 0) == SUCCESS && CA.CreateFile(1, 8) == FAIL && CA.ViewTable().size() == 1);
+	assert(CA.Access(1, 0) == FAIL);
+	assert(CA.Extend(1, 2) == SUCCESS && CA.ViewTable()[1].index == 128 && CA.Access(1, 9) == 129);
+
+	srand(23);
+
+	RandomCalls(CA, 3000, 60, 32, [&]() {
+		CheckBlocks(CA);
+		CheckGroups(CA);
+	});
+
+	int threads = 4, files = 24;
+
+	ConcurrentAllocation Shared(8, 4096, 8, 8);
+	vector<map<int, BlockIndex>> Lengths(threads);
+	vector<thread> Workers;
+
+	for (int t = 0 ; t < threads ; ++t) {
+
+		Workers.push_back(thread([&, t]() {
+
+			mt19937 Rand(t);
+			map<int, BlockIndex>& Length = Lengths[t];
+
+			for (int it = 0 ; it < 3000 ; ++it) {
+
+				// the files of thread t are t + 1, t + 1 + threads, ...
+				int fileID = t + 1 + threads * (Rand() % files);
+				BlockIndex amount = 1 + Rand() % 32;
+
+				if (Length.count(fileID) == 0) {
+					if (Shared.CreateFile(fileID, amount * Shared.block_size) == SUCCESS) Length[fileID] = amount;
+				} else if (Rand() % 2) {
+					if (Shared.Extend(fileID, amount) == SUCCESS) Length[fileID] += amount;
+				} else if (amount < Length[fileID]) {
+					assert(Shared.Shrink(fileID, amount) == SUCCESS);
+					Length[fileID] -= amount;
+				}
+			}
+		}));
+	}
+
+	for (thread& W : Workers) W.join();
+
+	CheckBlocks(Shared);
+	CheckGroups(Shared);
+
+	unordered_map<int, File> Files = Shared.ViewTable();
+	size_t created = 0;
+
+	for (auto& Length : Lengths) {
+
+		for (auto& el : Length) assert(Files[el.first].block_len == el.second);
+
+		created += Length.size();
+	}
+
+	assert(Files.size() == created);
+}
+
+/*
+	Returns whether two copies of a directory hold the same blocks, files
+	and free space, and Access finds the same block for every block of
+	every file
+*/
+template<typename Strategy>
+bool SameState(Strategy& A, Strategy& B) {
+
+	if (A.Slice(0, A.block_count) != B.Slice(0, B.block_count)) return false;
+	if (A.available_space != B.available_space) return false;
+
+	unordered_map<int, File> TableA = A.ViewTable(), TableB = B.ViewTable();
+
+	if (TableA.size() != TableB.size()) return false;
+
+	for (auto& el : TableA) {
+
+		if (TableB.count(el.first) == 0) return false;
+
+		File& F = TableB[el.first];
+
+		if (F.index != el.second.index || F.block_len != el.second.block_len || F.byte_len != el.second.byte_len) return false;
+
+		for (BlockIndex logical = 0 ; logical < F.block_len ; ++logical) {
+
+			long long offset = logical * A.block_size + 1;
+
+			if (A.Access(el.first, offset) != B.Access(el.first, offset)) return false;
+		}
+	}
+
+	return true;
+}
+
+/*
+	Saves a directory after random calls on half of the files, loads it
+	into a copy made with another size, and checks that both are the same
+	and stay the same while the same random calls, which now create the
+	other half of the files, are applied to both
+*/
+template<typename Strategy>
+void RoundTrip(Strategy& A, Strategy& B, unsigned seed) {
+
+	string path = "test_snapshot.img";
+	int next_id = 0;
+
+	srand(seed);
+	RandomCalls(A, 300, 30, 16, []() {});
+
+	assert(SaveSnapshot(path, A, 61) == SUCCESS);
+	assert(LoadSnapshot(path, B, next_id) == SUCCESS);
+	assert(next_id == 61 && B.block_count == A.block_count && SameState(A, B));
+
+	srand(seed + 1);
+	RandomCalls(A, 300, 60, 16, []() {});
+	srand(seed + 1);
+	RandomCalls(B, 300, 60, 16, []() {});
+
+	assert(SameState(A, B));
+
+	remove(path.c_str());
+}
+
+/*
+	Overwrites the given element of a region of a snapshot image
+*/
+template<typename T>
+void Patch(string path, int region, long long element, T value) {
+
+	SnapshotHeader H;
+	int fd = open(path.c_str(), O_RDWR);
+
+	assert(pread(fd, &H, sizeof(H), 0) == sizeof(H));
+	assert(pwrite(fd, &value, sizeof(T), H.Regions[region].offset + element * sizeof(T)) == sizeof(T));
+
+	close(fd);
+}
+
+/*
+	Checks that snapshots of contiguous and linked directories load back
+	into the same directory, and that an image cut short, or a linked one
+	whose chains or files point out of place, fails to load and leaves
+	the directory it was loaded into as it was
+*/
+void TestSnapshotRoundTrip() {
+
+	ContiguousAllocation First(8, 1024), FirstCopy(8, 64);
+	ContiguousAllocationT<BestFit> Best(8, 1024), BestCopy(8, 64);
+	LinkedAllocation Linked(16, 1024, 4), LinkedCopy(16, 64);
+
+	RoundTrip(First, FirstCopy, 25);
+	RoundTrip(Best, BestCopy, 26);
+	RoundTrip(Linked, LinkedCopy, 27);
+
+	string path = "test_snapshot.img";
+	int next_id = -1;
+
+	assert(SaveSnapshot(path, First, 61) == SUCCESS);
+
+	struct stat Info;
+
+	assert(stat(path.c_str(), &Info) == 0 && truncate(path.c_str(), Info.st_size - 1) == 0);
+
+	ContiguousAllocation Cut(8, 64);
+
+	assert(Cut.CreateFile(1, 8) == SUCCESS);
+	assert(LoadSnapshot(path, Cut, next_id) == FAIL);
+	assert(next_id == -1 && Cut.Access(1, 1) == 0 && Cut.available_space == 63);
+
+	// file 1 is on blocks 0 to 4, 8 and 9, file 2 on blocks 5 to 7
+	LinkedAllocation Chains(16, 256, 4);
+
+	assert(Chains.CreateFile(1, 60) == SUCCESS && Chains.CreateFile(2, 36) == SUCCESS && Chains.Extend(1, 2) == SUCCESS);
+
+	DirectoryTable::Slot Outside = {File(5000, 3, 36, 7), true};
+	LinkedFile Past(1), Cycle(1), Across(1);
+
+	Past.next = 1000;
+	Cycle.next = 0;
+	Across.next = 5;
+
+	for (int damage = 0 ; damage < 4 ; ++damage) {
+
+		LinkedAllocation Target(16, 64);
+
+		assert(Target.CreateFile(1, 12) == SUCCESS);
+		assert(SaveSnapshot(path, Chains, 3) == SUCCESS);
+
+		// a block past the directory, a chain that never ends, a chain
+		// going over blocks of another file and a file out of the directory
+		if (damage == 0) Patch(path, REGION_DIRECTORY, 4, Past);
+		if (damage == 1) Patch(path, REGION_DIRECTORY, 9, Cycle);
+		if (damage == 2) Patch(path, REGION_DIRECTORY, 4, Across);
+		if (damage == 3) Patch(path, REGION_DENSE, 2, Outside);
+
+		assert(LoadSnapshot(path, Target, next_id) == FAIL);
+		assert(next_id == -1 && Target.Access(1, 1) == 0 && Target.available_space == 63 && Target.block_count == 64);
+	}
+
+	LinkedAllocation Target(16, 64);
+
+	assert(SaveSnapshot(path, Chains, 3) == SUCCESS && LoadSnapshot(path, Target, next_id) == SUCCESS);
+	assert(next_id == 3 && Target.Access(1, 12 * 6 + 1) == 9 && Target.Jumps[1] == vector<BlockIndex>({0, 4}));
+
+	remove(path.c_str());
+}
 
 int main() {
 
+	TestDirectoryTable();
+	TestFreeExtentTree();
+	TestFreeBitmap();
+	TestIndexedAllocation();
+	TestExtentAllocation();
+	TestLinkedTail();
+	TestLinkedJumps();
+	TestTraceRoundTrip();
+	TestBuddyAllocation();
+	TestConcurrentAllocation();
+	TestPlacementPolicies();
+	TestSnapshotRoundTrip();
+
 	ContiguousAllocation CA(8);
 	LinkedAllocation LA(8);
 
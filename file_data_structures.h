@@ -1,8 +1,11 @@
+#pragma once
+
 #include <iostream>
 #include <algorithm>
 #include <cassert>
 #include <cmath>
 #include <map>
+#include <set>
 #include <stdio.h>
 #include <stdlib.h>
 #include <cstring>
@@ -10,6 +13,13 @@
 #include <string>
 #include <vector>
 #include <unordered_map>
+#include <new>
+#include <sys/mman.h>
+#include "log_queue.h"
+
+#if defined(__AVX2__) || defined(__SSE4_1__)
+#include <immintrin.h>
+#endif
 
 using namespace std;
 
@@ -70,47 +80,262 @@ void _print(T t, V... v) {
 #define NULL_ID -1
 #define POINTER_SIZE 4
 
+/*
+  Blocks are indexed with 64 bit integers so that volumes are not
+  limited to the range of int
+*/
+typedef long long BlockIndex;
+
+/*
+  This struct type owns an array of count elements of type T, which is
+  mapped directly from the operating system instead of being taken from
+  the heap. The array starts zero filled and pages are only committed
+  once they are written, and transparent huge pages are requested for
+  large arrays, so volumes of billions of blocks can be simulated. T must
+  be a type for which all bytes being zero is a valid (empty) value.
+*/
+template<typename T>
+struct BlockStorage {
+
+  T* Data;
+  BlockIndex count;
+  size_t bytes;
+
+  BlockStorage(): Data(NULL), count(0), bytes(0) {}
+
+  BlockStorage(BlockIndex _count): count(_count) {
+
+    bytes = max((size_t) count * sizeof(T), (size_t) 1);
+
+    void* ptr = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+
+    if (ptr == MAP_FAILED) throw bad_alloc();
+
+    // huge pages only pay off for arrays spanning several of them
+    if (bytes >= (1 << 21)) madvise(ptr, bytes, MADV_HUGEPAGE);
+
+    Data = (T*) ptr;
+  }
+
+  /*
+    Maps count elements stored in the file fd at the given offset, which
+    is a multiple of the page size, without reading them. The mapping is
+    private, so pages are read from the file when first touched and
+    writes are copied and never reach the file. Data is NULL if the file
+    cannot be mapped.
+  */
+  BlockStorage(int fd, long long offset, BlockIndex _count): count(_count) {
+
+    bytes = max((size_t) count * sizeof(T), (size_t) 1);
+
+    void* ptr = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, offset);
+
+    Data = ptr == MAP_FAILED ? NULL : (T*) ptr;
+  }
+
+  BlockStorage(const BlockStorage&) = delete;
+  BlockStorage& operator=(const BlockStorage&) = delete;
+
+  BlockStorage(BlockStorage&& B): Data(NULL), count(0), bytes(0) {
+    Swap(B);
+  }
+
+  BlockStorage& operator=(BlockStorage&& B) {
+    Swap(B);
+    return *this;
+  }
+
+  ~BlockStorage() {
+    if (Data != NULL) munmap(Data, bytes);
+  }
+
+  void Swap(BlockStorage& B) {
+    swap(Data, B.Data);
+    swap(count, B.count);
+    swap(bytes, B.bytes);
+  }
+
+  T& operator[](BlockIndex i) {
+    return Data[i];
+  }
+
+  const T& operator[](BlockIndex i) const {
+    return Data[i];
+  }
+
+  BlockIndex size() const {
+    return count;
+  }
+};
+
+/*
+  This struct type holds the fragmentation gauges and relocation counters
+  of an allocation method. Gauges describe the directory at the time they
+  are taken, counters add up from its creation. Fields are doubles so that
+  attempts can be averaged. Its attributes:
+
+  free_blocks:            number of free blocks
+  free_extents:           number of maximal runs of free blocks
+  largest_free_extent:    length of the longest run of free blocks
+  external_fragmentation: share of free blocks that are outside the longest
+                          free run, zero when all free space is one run
+  internal_fragmentation: bytes taken on the directory that hold no data
+                          of any file
+  average_run_length:     average number of blocks in a run of physically
+                          consecutive blocks of a file
+  average_chain_distance: average distance in blocks between a block of a
+                          linked file and the next one in its chain, zero
+                          for methods without chains
+  compactions:            number of compactions
+  blocks_moved:           blocks relocated by compactions
+  shift_moves:            blocks relocated by shifting files to make room
+                          for an extension
+*/
+struct SpaceMetrics {
+
+  double free_blocks = 0.0;
+  double free_extents = 0.0;
+  double largest_free_extent = 0.0;
+  double external_fragmentation = 0.0;
+  double internal_fragmentation = 0.0;
+  double average_run_length = 0.0;
+  double average_chain_distance = 0.0;
+  double compactions = 0.0;
+  double blocks_moved = 0.0;
+  double shift_moves = 0.0;
+
+  /*
+    Sets the gauges of free space from the number of free runs, the
+    longest of them and the number of free blocks
+  */
+  void SetFree(BlockIndex runs, BlockIndex largest, BlockIndex free) {
+
+    free_blocks = free;
+    free_extents = runs;
+    largest_free_extent = largest;
+    external_fragmentation = free == 0 ? 0.0 : 1.0 - (double) largest / free;
+  }
+
+  void Add(const SpaceMetrics& M) {
+
+    free_blocks += M.free_blocks;
+    free_extents += M.free_extents;
+    largest_free_extent += M.largest_free_extent;
+    external_fragmentation += M.external_fragmentation;
+    internal_fragmentation += M.internal_fragmentation;
+    average_run_length += M.average_run_length;
+    average_chain_distance += M.average_chain_distance;
+    compactions += M.compactions;
+    blocks_moved += M.blocks_moved;
+    shift_moves += M.shift_moves;
+  }
+
+  void Div(double num) {
+
+    free_blocks /= num;
+    free_extents /= num;
+    largest_free_extent /= num;
+    external_fragmentation /= num;
+    internal_fragmentation /= num;
+    average_run_length /= num;
+    average_chain_distance /= num;
+    compactions /= num;
+    blocks_moved /= num;
+    shift_moves /= num;
+  }
+};
+
+/*
+  This struct type is the interface shared by all allocation methods, for
+  callers that pick the method at run time. The experiment itself is
+  instantiated for every method, which are all final, so their calls are
+  resolved at compile time instead of going through this interface.
+*/
 struct Allocation {
 
   Allocation() {}
 
-  virtual int CreateFile(int fileID, int length) = 0;
+  virtual int CreateFile(int fileID, long long length) = 0;
+
+  virtual BlockIndex Access(int fileID, long long byte_offset) = 0;
+
+  virtual int Extend(int fileID, BlockIndex extension_amount) = 0;
+
+  virtual int Shrink(int fileID, BlockIndex shrink_amount) = 0;
 
-  virtual int Access(int fileID, int byte_offset) = 0;
+  /*
+    Returns the average number of runs of physically consecutive
+    blocks that the files in the directory are split into
+  */
+  virtual double ExtentsPerFile() = 0;
+
+  /*
+    Returns the memory in bytes used by in-memory indexes that only
+    exist to speed up Access, strategies without one report zero
+  */
+  virtual long long JumpIndexBytes() {
+    return 0;
+  }
 
-  virtual int Extend(int fileID, int extension_amount) = 0;
+  /*
+    Returns the fragmentation gauges and relocation counters of the
+    directory. Counters are kept as the directory changes, while gauges
+    are computed when this is called, in time at most linear in the
+    number of blocks
+  */
+  virtual SpaceMetrics Metrics() = 0;
 
-  virtual int Shrink(int fileID, int shrink_amount) = 0;
+  /*
+    Returns the gauges of free space and the counters only, leaving the
+    gauges that depend on files at zero. It does not allocate memory and
+    takes at most linear time in the number of blocks, so it can be
+    sampled while the experiment runs
+  */
+  virtual SpaceMetrics FreeMetrics() = 0;
 };
 
 /*
   This struct type is used to LogIssue any issues or unexpected behaviour. Its
   constructor reieves the name of the class the struct is being used in.
+  Messages are a printf format with up to LOG_ARGS integer arguments, they
+  are handed to the shared LogQueue and formatted by its background thread,
+  and messages below LOG_LEVEL are removed at compile time.
 */
 struct GeneralLogger {
 
-  string class_name;
+  const char* class_name;
+
+  GeneralLogger(): class_name("") {}
+  GeneralLogger(const char* _class_name): class_name(_class_name) {}
+
+  template<typename... Args>
+  void Log(int level, const char* func_name, const char* format, Args... args) {
 
-  GeneralLogger() {}
-  GeneralLogger(string _class_name): class_name(_class_name) {}
+    static_assert(sizeof...(args) <= LOG_ARGS, "too many log arguments");
+
+    LogRecord R = {level, class_name, func_name, format, {(long long) args...}};
+
+    GetLogQueue().Push(R);
+  }
 
   /*
     This function recieves the name of the function that an issue has appeared
-    in, and a string describing the error. Then it concatenates all necessary
-    information and prints it to standard error.
+    in, and a format describing the error with its arguments. Issues are
+    written to standard output.
   */
-  void LogIssue(string func_name, string error) {
-
-    string Res = "Issue: " + class_name + ": " + func_name + ": " + error + "\n";
+  template<typename... Args>
+  void LogIssue(const char* func_name, const char* format, Args... args) {
 
-    cout << Res ;
+    if constexpr (LOG_LEVEL <= LOG_LEVEL_ISSUE) Log(LOG_LEVEL_ISSUE, func_name, format, args...);
   }
 
-  void LogInfo(string func_name, string msg) {
-
-    string Res = "Info: " + class_name + ": " + func_name + ": " + msg + "\n";
+  /*
+    Infos are written to standard error
+  */
+  template<typename... Args>
+  void LogInfo(const char* func_name, const char* format, Args... args) {
 
-    cerr << Res;
+    if constexpr (LOG_LEVEL <= LOG_LEVEL_INFO) Log(LOG_LEVEL_INFO, func_name, format, args...);
   }
 };
 
@@ -119,15 +344,19 @@ struct GeneralLogger {
   index:      index at which the first block of the file is stored in Directory
   block_len:  number of blocks occupied by the file
   byte_len:   number of bytes occupied by the file
+  tail:       index at which the last block of the file is stored, it is
+              only kept by allocation strategies that need it
 */
 struct File {
 
-  int index;
-  int block_len;
-  int byte_len;
+  BlockIndex index;
+  BlockIndex block_len;
+  long long byte_len;
+  BlockIndex tail;
 
   File() {}
-  File(int index, int block_len, int byte_len): index(index), block_len(block_len), byte_len(byte_len) {}
+  File(BlockIndex index, BlockIndex block_len, long long byte_len): index(index), block_len(block_len), byte_len(byte_len), tail(END_OF_FILE) {}
+  File(BlockIndex index, BlockIndex block_len, long long byte_len, BlockIndex tail): index(index), block_len(block_len), byte_len(byte_len), tail(tail) {}
 
   bool operator<(const File& F) const {
     return index < F.index;
@@ -145,18 +374,50 @@ struct File {
 */
 File NullFile = File(-1, -1, -1);
 
+#define DENSE_IDS (1 << 24)
+
 /*
   This function represents the data structure that holds info about files
-  in the directory. It consists of a mapping whose key is the file ID, and
-  whose value the file metadata represented by File struct defined above.
+  in the directory. It maps file IDs to the file metadata represented by
+  File struct defined above. File IDs are handed out sequentially, so the
+  metadata of IDs below DENSE_IDS is stored in a vector indexed by ID, where
+  a lookup is a single array access, and only larger or negative IDs go to
+  a hash map. Every slot of the vector says whether its ID has a file,
+  since no index can tell it: END_OF_FILE is the index of files that have
+  no blocks. Callers should look a file up once with Find and work on the
+  returned pointer, the other functions are kept for convenience.
 */
 struct DirectoryTable {
 
-  // this map has file ID as key and file metadata as value
-  unordered_map<int, File> Table;
+  struct Slot {
+    File F;
+    bool used;
+  };
+
+  vector<Slot> Dense;
+  unordered_map<int, File> Sparse;
+  size_t file_count;
   GeneralLogger Logger;
 
-  DirectoryTable(): Logger(GeneralLogger("DirectoryTable")) {}
+  DirectoryTable(): file_count(0), Logger(GeneralLogger("DirectoryTable")) {}
+
+  /*
+    This function returns a pointer to the metadata of the given file,
+    which stays valid until a file is added, or NULL if it does not exist
+  */
+  File* Find(int fileID) {
+
+    if (0 <= fileID && fileID < DENSE_IDS) {
+
+      if ((size_t) fileID < Dense.size() && Dense[fileID].used) return &Dense[fileID].F;
+
+      return NULL;
+    }
+
+    auto it = Sparse.find(fileID);
+
+    return it == Sparse.end() ? NULL : &it->second;
+  }
 
   /*
     This function checkes if a file exists in the directory given
@@ -164,7 +425,7 @@ struct DirectoryTable {
   */
   bool FileExists(int fileID) {
 
-    return Table.count(fileID);
+    return Find(fileID) != NULL;
   }
 
   /*
@@ -172,13 +433,15 @@ struct DirectoryTable {
   */
   File GetFile(int fileID) {
 
+    File* F = Find(fileID);
+
     // if a file does not exist, raise an issue
-    if (!Table.count(fileID)) {
+    if (F == NULL) {
       Logger.LogIssue("GetFile", "Requesting an entry that does not exist");
       return NullFile;
     }
 
-    return Table[fileID];
+    return *F;
   }
 
   /*
@@ -187,12 +450,22 @@ struct DirectoryTable {
   int AddFile(int fileID, File entry) {
 
     // If a file of the given fileID already exists, raise an issue.
-    if (Table.count(fileID)) {
+    if (Find(fileID) != NULL) {
       Logger.LogIssue("AddFile", "Cannot add Entry that already exists");
       return FAIL;
     }
 
-    Table[fileID] = entry;
+    if (0 <= fileID && fileID < DENSE_IDS) {
+
+      if (Dense.size() <= (size_t) fileID) Dense.resize(max((size_t) fileID + 1, 2 * Dense.size()), {NullFile, false});
+
+      Dense[fileID] = {entry, true};
+
+    } else {
+      Sparse[fileID] = entry;
+    }
+
+    file_count++;
 
     return SUCCESS;
   }
@@ -202,14 +475,22 @@ struct DirectoryTable {
   */
   int RemoveFile(int fileID) {
 
+    File* F = Find(fileID);
+
     // if file does not exist, raise an issue, because we expect
     // a file we remove to exist
-    if (!Table.count(fileID)) {
+    if (F == NULL) {
       Logger.LogIssue("RemoveFile", "Cannot Remove Entry that does not exist");
       return FAIL;
     }
 
-    Table.erase(fileID);
+    if (0 <= fileID && fileID < DENSE_IDS) {
+      Dense[fileID] = {NullFile, false};
+    } else {
+      Sparse.erase(fileID);
+    }
+
+    file_count--;
 
     return SUCCESS;
   }
@@ -219,364 +500,2577 @@ struct DirectoryTable {
     Remember: the index is the index of the block at which this file
     starts in the Directory.
   */
-  int UpdateIndex(int fileID, int new_index) {
+  int UpdateIndex(int fileID, BlockIndex new_index) {
+
+    File* F = Find(fileID);
 
     // if file does not exist, raise an issue
-    if (!Table.count(fileID)) {
+    if (F == NULL) {
       Logger.LogIssue("UpdateIndex", "Given fileID does not exist");
       return FAIL;
     }
 
-    Table[fileID].index = new_index;
+    F->index = new_index;
 
     return SUCCESS;
   }
 
   /*
-    This function updates the length of bytes of a file in the directory
+    Returns the number of files in the directory
   */
-  int UpdateByteLen(int fileID, int new_len) {
+  size_t size() {
+    return file_count;
+  }
 
-    // if file does not exist, raise an issue
-    if (!Table.count(fileID)) {
-      Logger.LogIssue("UpdateByteLength", "Given fileID does not exist");
-      return FAIL;
-    }
+  bool empty() {
+    return file_count == 0;
+  }
 
-    Table[fileID].byte_len = new_len;
+  /*
+    This function calls Visit(fileID, F) for every file of the directory,
+    files with dense IDs are visited in increasing order of ID
+  */
+  template<typename Visitor>
+  void ForEach(Visitor Visit) {
 
-    return SUCCESS;
+    for (size_t i = 0 ; i < Dense.size() ; ++i) {
+      if (Dense[i].used) Visit((int) i, Dense[i].F);
+    }
+
+    for (auto& el : Sparse) Visit(el.first, el.second);
   }
 
   /*
-    This function updates the length of blocks of a file in the directory
+    This function sets the gauges of M that depend on files: internal
+    fragmentation, given the number of blocks taken on the directory,
+    and average run length, given the average number of runs per file
   */
-  int UpdateBlockLen(int fileID, int new_len) {
+  void SetFileMetrics(SpaceMetrics& M, BlockIndex taken, int block_size, double extents_per_file) {
 
-    // if file does not exist, raise an issue
-    if (!Table.count(fileID)) {
-      Logger.LogIssue("UpdateBlockLen", "Given fileID does not exist");
-      return FAIL;
-    }
+    long long bytes = 0;
+    BlockIndex blocks = 0;
 
-    Table[fileID].block_len = new_len;
+    ForEach([&](int, File& F) {
+      bytes += F.byte_len;
+      blocks += F.block_len;
+    });
 
-    return SUCCESS;
+    double runs = extents_per_file * file_count;
+
+    M.internal_fragmentation = taken * block_size - bytes;
+    M.average_run_length = runs == 0 ? 0.0 : blocks / runs;
   }
 
+  /*
+    Returns a copy of the table as a map from file ID to metadata
+  */
+  unordered_map<int, File> ToMap() {
+
+    unordered_map<int, File> Res;
+
+    ForEach([&](int fileID, File& F) { Res[fileID] = F; });
+
+    return Res;
+  }
 };
 
 /*
-  This struct type encapsulates a file system implemented with
-  Contiguous Allocation strategy. Its attributes are:
-
-  block_size:       the size of each block in the directory
-  available_space:  stores the available space left in the directory it
-                    makes it easier and faster for several operations
-  Directory:        represents the blocks of the directory
-  Table:            represents the Directory Table data structure
-  Logger:           used to LogIssue issues to standard error
+  This struct type keeps one bit per block of a directory, where a set bit
+  is a free block, packed in 64 bit words. Free blocks are found with
+  ctz on whole words, and words that have no free block at all (or no
+  occupied block at all) are skipped several at a time using vector
+  registers when the compiler targets AVX2 (4 words, i.e. 256 blocks per
+  step) or SSE4.1 (2 words), otherwise one word at a time. Bits past
+  block_count are never set.
+
+  block_count:  number of blocks being tracked
+  word_count:   number of words in Words
+  Words:        the packed bitmap
 */
-struct ContiguousAllocation : Allocation {
+struct FreeBitmap {
 
-  int block_size;
-  int available_space;
-  int Directory[MAX_BLOCKS];
-  DirectoryTable Table;
-  GeneralLogger Logger;
+  BlockIndex block_count;
+  BlockIndex word_count;
+  BlockStorage<unsigned long long> Words;
 
-  ContiguousAllocation(int _block_size) {
+  FreeBitmap() {}
 
-    block_size = _block_size ;
-    available_space = MAX_BLOCKS;
-    Table = DirectoryTable();
-    Logger = GeneralLogger("ContiguousAllocation");
-    memset(Directory, EMPTY, sizeof(Directory));
+  FreeBitmap(BlockIndex _block_count, BlockIndex _word_count) {
+
+    block_count = _block_count;
+    word_count = _word_count;
+    Words = BlockStorage<unsigned long long>(word_count);
+
+    // initially all blocks are free
+    SetRange(0, block_count, true);
   }
 
-  /*
-    Takes length of bytes and returns number of blocks required
-    to store these bytes, which is taken by dividing length by
-    block size and taking the ceil value
-  */
-  int ByteToBlock(int length) {
+  FreeBitmap(BlockIndex _block_count): FreeBitmap(_block_count, (_block_count + 63) / 64) {}
 
-    return (length + block_size - 1) / block_size;
+  bool IsFree(BlockIndex index) {
+    return Words[index / 64] >> (index % 64) & 1;
   }
 
   /*
-    This function takes a file ID and a new index, and moves that file
-    to start from the new index. If while moving the file, some part of
-    the destination appears to be occupied, the operation fails.
+    Marks a single block as free or occupied
   */
-  int Move(int fileID, int new_index) {
-
-    File F = Table.GetFile(fileID);
-
-    if (F == NullFile) {
-      Logger.LogIssue("Move", "Cannot Get file");
-      return FAIL;
-    }
+  void Set(BlockIndex index, bool free) {
 
-    int old_index = F.index;
+    if (free) Words[index / 64] |= 1ULL << (index % 64);
+    else Words[index / 64] &= ~(1ULL << (index % 64));
+  }
 
-    for (int i = 0 ; i < F.block_len ; ++i) {
+  /*
+    Marks the blocks in the range starting at index and having the given
+    length as free or occupied. Returns the range of words that were
+    touched as a pair of first and last word.
+  */
+  pair<BlockIndex, BlockIndex> SetRange(BlockIndex index, BlockIndex length, bool free) {
 
-      if (Directory[new_index + i] != EMPTY) {
-        string info = ", moving from " + to_string(old_index) + " to " + to_string(new_index) + ", length: " + to_string(F.block_len);
-        Logger.LogIssue("Move", "Failed to Move because destination is occupied at " + to_string(new_index + i) + info);
-        return FAIL;
-      }
+    BlockIndex first = index / 64, last = (index + length - 1) / 64;
 
-      // move block by block, each block is moved directly
-      // from its old block to its new block
+    for (BlockIndex w = first ; w <= last ; ++w) {
 
-      Directory[new_index + i] = fileID;
-      Directory[old_index + i] = EMPTY;
-    }
+      BlockIndex l = max(index, w * 64) - w * 64;
+      BlockIndex r = min(index + length, w * 64 + 64) - w * 64;
 
-    // update index in Directory Table
-    int status = Table.UpdateIndex(fileID, new_index);
+      unsigned long long mask = r - l == 64 ? ~0ULL : ((1ULL << (r - l)) - 1) << l;
 
-    if (status == FAIL) {
-      Logger.LogIssue("Move", "Cannot Update Index");
-      return status;
+      if (free) Words[w] |= mask;
+      else Words[w] &= ~mask;
     }
 
-    return SUCCESS;
+    return make_pair(first, last);
   }
 
   /*
-    This function shifts the contents of a file from left to right by a certain
-    amount. It assumes that there is enough space on the right for shifting
+    Returns the first word starting from w that is different from skip,
+    or word_count if there is none. Words equal to skip are passed over
+    in whole vector registers where available.
   */
+  BlockIndex SkipWords(BlockIndex w, unsigned long long skip) {
 
-  int Shift(int fileID, int amount) {
+#if defined(__AVX2__)
+    __m256i pattern = _mm256_set1_epi64x(skip);
 
-    File F = Table.GetFile(fileID);
+    for ( ; w + 4 <= word_count ; w += 4) {
 
-    if (F == NullFile) {
-      Logger.LogIssue("Shift", "Issue in Getting file from table");
-      return FAIL;
-    }
+      __m256i v = _mm256_loadu_si256((const __m256i*) &Words[w]);
 
-    int index = F.index + F.block_len - 1;
+      if (_mm256_movemask_epi8(_mm256_cmpeq_epi64(v, pattern)) != -1) break;
+    }
+#elif defined(__SSE4_1__)
+    __m128i pattern = _mm_set1_epi64x(skip);
 
-    for (int i = index ; F.index <= i ; --i) {
+    for ( ; w + 2 <= word_count ; w += 2) {
 
-      if (Directory[i + amount] != EMPTY) {
-        Logger.LogIssue("Shift", "It is assumed that destination is empty, but it's not");
-        return FAIL;
-      }
+      __m128i v = _mm_loadu_si128((const __m128i*) &Words[w]);
 
-      Directory[i] = EMPTY;
-      Directory[i + amount] = fileID;
+      if (_mm_movemask_epi8(_mm_cmpeq_epi64(v, pattern)) != 0xFFFF) break;
     }
+#endif
 
-    Table.UpdateIndex(fileID, F.index + amount);
+    while (w < word_count && Words[w] == skip) w++;
 
-    return SUCCESS;
+    return w;
   }
 
   /*
-    This function applies a compaction operation on the directory, this
-    operation is defined as follows, for all files stored in the directory
-    the files are shifted from high indexes to low indexes in a way such
-    that all blocks from the beginning of the directory are covered, leaving
-    all available empty space at the end of the directory, which makes enough
-    space for new additions or extensions.
-
-    The compaction is implemented to work in linear time in terms of directory
-    space. Also, it does not require any additional memory, as shifts of blocks
-    all are being done in place block by block.
-
-    A start index is given to the function because in some cases we will need to
-    apply compaction on some suffix of the directory, this is specifically in
-    cases where we apply compaction for extension, as after first compaction we
-    want to move the file we want to extend to this end, which leaves its space
-    empty, so we might want to do compaction again that case.
+    Returns the first word starting from w that contains a free block,
+    or word_count if there is none
   */
-  int ApplyCompaction(int start_index) {
-
-    Logger.LogInfo("ApplyCompation", "Applying Compaction starting from " + to_string(start_index));
-
-    // last stores the index at which we expect to do
-    // our next insertion
-    int last = start_index;
-    int increment;
-
-    for (int i = start_index ; i < MAX_BLOCKS ; i += increment) {
-
-      increment = 1;
+  BlockIndex SkipFull(BlockIndex w) {
+    return SkipWords(w, 0);
+  }
 
-      if (Directory[i] == EMPTY) continue;
+  /*
+    Returns the index of the first free block at or after index,
+    or FAIL if there is none
+  */
+  BlockIndex FindNextFree(BlockIndex index) {
 
-      if (last == i) {
-        last++;
-        continue;
-      }
+    if (block_count <= index) return FAIL;
 
-      int ID = Directory[i];
+    BlockIndex w = index / 64;
+    unsigned long long word = Words[w] & (~0ULL << (index % 64));
 
+    if (!word) {
 
-      // use move function to move the directory
-      int status = Move(Directory[i], last);
+      w = SkipFull(w + 1);
 
-      if (status == FAIL) {
-        Logger.LogIssue("ApplyCompaction:", "Failed to compact due to Move issue");
-        return status;
-      }
+      if (w == word_count) return FAIL;
 
-      // after moving a file, increase the last index
-      // by the length of the file, because that will
-      // be the place at which the next file should be
-      // inserted
-      increment = Table.GetFile(ID).block_len;;
-      last += increment;
+      word = Words[w];
     }
 
-    return SUCCESS;
+    return w * 64 + __builtin_ctzll(word);
   }
 
   /*
-    This function checks if it is possible to extend a file
-    to a certain region starting at the given index and has
-    length of the amount given
+    This function counts the maximal runs of free blocks and finds the
+    length of the longest one, jumping from run to run
   */
-  bool CanExtend(int index, int amount) {
+  void RunStats(BlockIndex& runs, BlockIndex& largest) {
 
-    for (int i = index ; i < index + amount ; ++i) {
+    runs = 0;
+    largest = 0;
 
-      if (Directory[i] != EMPTY) return false;
-    }
+    for (BlockIndex i = FindNextFree(0) ; i != FAIL ; ) {
 
-    return true;
+      BlockIndex j = FindNextUsed(i);
+
+      if (j == FAIL) j = block_count;
+
+      runs++;
+      largest = max(largest, j - i);
+      i = FindNextFree(j);
+    }
   }
 
   /*
-    This function attempts to find a space for a file of a
-    given block length, it returns the index of the first
-    spot found that fits the required number of blocks
+    Returns the index of the first occupied block at or after index,
+    or FAIL if there is none
   */
-  int FindAvailableSpace(int block_num) {
+  BlockIndex FindNextUsed(BlockIndex index) {
 
-    for (int i = 0, j ; i < MAX_BLOCKS ; i = j) {
+    if (block_count <= index) return FAIL;
 
-      j = i + 1;
+    BlockIndex w = index / 64;
+    unsigned long long word = ~Words[w] & (~0ULL << (index % 64));
 
-      if (Directory[i] != EMPTY) continue;
+    if (!word) {
 
-      // if an empty spot is found, check if there are block_num
-      // consecutive empty spots starting from that one
-      while (j < MAX_BLOCKS && Directory[j] == EMPTY) {
+      w = SkipWords(w + 1, ~0ULL);
 
-        // if enough space is reached, quit the loop
-        if (j - i == block_num) break;
-
-        j++;
-      }
+      if (w == word_count) return FAIL;
 
-      if (j - i == block_num) return i;
+      word = ~Words[w];
     }
 
-    return FAIL;
+    BlockIndex used = w * 64 + __builtin_ctzll(word);
+
+    // padding bits past block_count are never free
+    return used < block_count ? used : FAIL;
   }
 
   /*
-    This function places a file in the directory by filling
-    Directory blocks with the fileID of the file being inserted
+    This function collects the indexes of the first count free blocks
+    into Res, in increasing order. Fewer indexes are collected if there
+    are not enough free blocks.
   */
-  int Fill(int fileID, int index, int length) {
-
-    for (int i = index ; i < index + length ; ++i) {
+  void Collect(BlockIndex count, vector<BlockIndex>& Res) {
 
-      if (Directory[i] != EMPTY) {
+    for (BlockIndex w = SkipFull(0) ; w < word_count && (BlockIndex) Res.size() < count ; w = SkipFull(w + 1)) {
 
-        string info = " at " + to_string(i) +  ", filling from " + to_string(index) + " to " + to_string(index + length - 1);
-        Logger.LogIssue("Fill", "Cannot fill in already full slot" + info);
-        return FAIL;
+      // extract set bits from the lowest one
+      for (unsigned long long word = Words[w] ; word && (BlockIndex) Res.size() < count ; word &= word - 1) {
+        Res.push_back(w * 64 + __builtin_ctzll(word));
       }
-
-      Directory[i] = fileID;
     }
-
-    return SUCCESS;
   }
 
   /*
-    This function does the opposite of Fill, it makes directory blocks
-    occupied by some file empty. Spots being emptied are expected to
-    be occupied
+    This function adds the indexes of the free blocks in [from, to) to
+    Res, in increasing order, until Res holds count indexes
   */
-  int Empty(int index, int length) {
+  void CollectRange(BlockIndex from, BlockIndex to, BlockIndex count, vector<BlockIndex>& Res) {
 
-    for (int i = index ; i < index + length ; ++i) {
+    for (BlockIndex i = FindNextFree(from) ; i != FAIL && i < to && (BlockIndex) Res.size() < count ; ) {
 
-      if (Directory[i] == EMPTY) {
-        Logger.LogIssue("Empty", "Attempting to empty an already Empty spot, this should not happen");
-        return FAIL;
+      BlockIndex w = i / 64;
+
+      for (unsigned long long word = Words[w] & (~0ULL << (i % 64)) ; word && (BlockIndex) Res.size() < count ; word &= word - 1) {
+
+        BlockIndex x = w * 64 + __builtin_ctzll(word);
+
+        if (to <= x) return;
+
+        Res.push_back(x);
       }
 
-      Directory[i] = EMPTY;
+      i = FindNextFree((w + 1) * 64);
     }
-
-    return SUCCESS;
+  }
+};
+
+/*
+  This struct type summarizes the free blocks of a range of the directory.
+  Its attributes:
+
+  pre:  length of the free run at the start of the range
+  suf:  length of the free run at the end of the range
+  best: length of the longest free run inside the range
+  runs: number of maximal free runs inside the range
+*/
+struct ExtentSummary {
+
+  BlockIndex pre;
+  BlockIndex suf;
+  BlockIndex best;
+  BlockIndex runs;
+
+  ExtentSummary(): pre(0), suf(0), best(0), runs(0) {}
+};
+
+/*
+  This struct type indexes the free space of a directory so that the first
+  run of at least N free blocks can be found in logarithmic time instead of
+  scanning the directory block by block.
+
+  Free blocks are stored in a FreeBitmap, and a segment tree is built on
+  top of its words where each node stores the ExtentSummary of the range
+  it covers. Reserving or releasing a range only recomputes the words of
+  that range and their ancestors.
+
+  word_count:   number of leaves in the tree, always a power of two
+  Bits:         the free bitmap, padded to word_count words
+  Nodes:        the segment tree, node i has children 2i and 2i + 1
+*/
+struct FreeExtentTree {
+
+  BlockIndex word_count;
+  FreeBitmap Bits;
+  BlockStorage<ExtentSummary> Nodes;
+
+  FreeExtentTree() {}
+
+  FreeExtentTree(BlockIndex block_count) {
+
+    word_count = 1;
+
+    while (word_count * 64 < block_count) word_count *= 2;
+
+    Bits = FreeBitmap(block_count, word_count);
+    Nodes = BlockStorage<ExtentSummary>(2 * word_count);
+
+    for (BlockIndex w = 0 ; w < word_count ; ++w) {
+      Nodes[w + word_count] = Leaf(Bits.Words[w]);
+    }
+
+    // build the tree level by level, nodes of a level are
+    // numbered from lo to 2 lo - 1
+    for (BlockIndex lo = word_count / 2, half = 64 ; 1 <= lo ; lo /= 2, half *= 2) {
+
+      for (BlockIndex i = lo ; i < 2 * lo ; ++i) {
+        Nodes[i] = Merge(Nodes[2 * i], Nodes[2 * i + 1], half);
+      }
+    }
+  }
+
+  /*
+    Computes the summary of a single bitmap word
+  */
+  ExtentSummary Leaf(unsigned long long word) {
+
+    ExtentSummary S;
+
+    if (word == ~0ULL) {
+      S.pre = S.suf = S.best = 64;
+      S.runs = 1;
+      return S;
+    }
+
+    S.pre = __builtin_ctzll(~word);
+    S.suf = __builtin_clzll(~word);
+    S.runs = __builtin_popcountll(word & ~(word << 1));
+
+    // every iteration shortens each run of set bits by one,
+    // so the number of iterations is the longest run
+    for (unsigned long long x = word ; x ; x &= x >> 1) S.best++;
+
+    return S;
+  }
+
+  /*
+    Combines the summaries of two adjacent ranges, each of them
+    having a length of half blocks
+  */
+  ExtentSummary Merge(const ExtentSummary& L, const ExtentSummary& R, BlockIndex half) {
+
+    ExtentSummary S;
+
+    S.pre = L.pre == half ? half + R.pre : L.pre;
+    S.suf = R.suf == half ? half + L.suf : R.suf;
+    S.best = max(max(L.best, R.best), L.suf + R.pre);
+    S.runs = L.runs + R.runs - (L.suf > 0 && R.pre > 0);
+
+    return S;
+  }
+
+  /*
+    This function marks the blocks in the range starting at index and
+    having the given length as free or occupied, and then updates the
+    summaries of all tree nodes covering the range
+  */
+  void SetRange(BlockIndex index, BlockIndex length, bool free) {
+
+    if (length <= 0) return;
+
+    pair<BlockIndex, BlockIndex> words = Bits.SetRange(index, length, free);
+
+    BlockIndex lo = words.first + word_count, hi = words.second + word_count;
+
+    for (BlockIndex i = lo ; i <= hi ; ++i) {
+      Nodes[i] = Leaf(Bits.Words[i - word_count]);
+    }
+
+    // recompute parents level by level, at each level the
+    // covered range of nodes is halved
+    for (BlockIndex half = 64 ; 1 < lo ; half *= 2) {
+
+      lo /= 2;
+      hi /= 2;
+
+      for (BlockIndex i = lo ; i <= hi ; ++i) {
+        Nodes[i] = Merge(Nodes[2 * i], Nodes[2 * i + 1], half);
+      }
+    }
+  }
+
+  /*
+    Marks a range of blocks as occupied
+  */
+  void Reserve(BlockIndex index, BlockIndex length) {
+    SetRange(index, length, false);
+  }
+
+  /*
+    Marks a range of blocks as free
+  */
+  void Release(BlockIndex index, BlockIndex length) {
+    SetRange(index, length, true);
+  }
+
+  /*
+    This function searches the node covering the range starting at lo and
+    having a length of span, for the first run of length free blocks that
+    starts at or after pos. carry holds the length of the free run that
+    ends right before lo, and it is updated as ranges are passed over.
+  */
+  BlockIndex Search(BlockIndex node, BlockIndex lo, BlockIndex span, BlockIndex pos, BlockIndex length, BlockIndex& carry) {
+
+    // ranges before pos do not take part in the search
+    if (lo + span <= pos) return FAIL;
+
+    const ExtentSummary& S = Nodes[node];
+
+    if (pos <= lo) {
+
+      // the run that started before this range ends inside it
+      if (length <= carry + S.pre) return lo - carry;
+
+      // no run inside this range is long enough, skip it entirely
+      if (S.best < length) {
+        carry = S.pre == span ? carry + span : S.suf;
+        return FAIL;
+      }
+    }
+
+    // a leaf is resolved bit by bit
+    if (span == 64) {
+
+      unsigned long long word = Bits.Words[node - word_count];
+
+      for (BlockIndex b = max(pos - lo, 0LL) ; b < 64 ; ++b) {
+
+        if (!(word >> b & 1)) {
+          carry = 0;
+          continue;
+        }
+
+        carry++;
+
+        if (length <= carry) return lo + b - carry + 1;
+      }
+
+      return FAIL;
+    }
+
+    BlockIndex half = span / 2;
+
+    BlockIndex index = Search(2 * node, lo, half, pos, length, carry);
+
+    if (index != FAIL) return index;
+
+    return Search(2 * node + 1, lo + half, half, pos, length, carry);
+  }
+
+  /*
+    Returns the index of the first run of at least length free
+    blocks that starts at or after pos, or FAIL if there is none
+  */
+  BlockIndex FindFrom(BlockIndex pos, BlockIndex length) {
+
+    BlockIndex carry = 0;
+
+    return Search(1, 0, word_count * 64, pos, length, carry);
+  }
+
+  /*
+    Returns the index of the first run of at least length free
+    blocks, or FAIL if there is none
+  */
+  BlockIndex FindFirstFit(BlockIndex length) {
+    return FindFrom(0, length);
+  }
+
+  /*
+    Returns the length of the longest run of free blocks
+  */
+  BlockIndex LargestExtent() {
+    return Nodes[1].best;
+  }
+
+  /*
+    Returns the number of maximal runs of free blocks
+  */
+  BlockIndex ExtentCount() {
+    return Nodes[1].runs;
+  }
+};
+
+/*
+  This struct type keeps the free runs of a directory ordered both by
+  position and by length, for placement policies that pick a run by its
+  length. Runs are split when blocks inside them are reserved and merged
+  with their neighbours when blocks next to them are released, each in
+  logarithmic time. Its attributes:
+
+  Runs:     the first block of every free run mapped to its length
+  BySize:   (length, first block) of every free run
+*/
+struct FreeExtentMap {
+
+  map<BlockIndex, BlockIndex> Runs;
+  set<pair<BlockIndex, BlockIndex>> BySize;
+
+  void Init(BlockIndex block_count) {
+
+    Runs.clear();
+    BySize.clear();
+
+    if (0 < block_count) Add(0, block_count);
+  }
+
+  void Add(BlockIndex index, BlockIndex length) {
+    Runs[index] = length;
+    BySize.insert(make_pair(length, index));
+  }
+
+  void Remove(map<BlockIndex, BlockIndex>::iterator it) {
+    BySize.erase(make_pair(it->second, it->first));
+    Runs.erase(it);
+  }
+
+  /*
+    Marks a range of free blocks as used, the range lies within a
+    single free run
+  */
+  void Reserve(BlockIndex index, BlockIndex length) {
+
+    if (length <= 0) return;
+
+    auto it = prev(Runs.upper_bound(index));
+
+    BlockIndex start = it->first, end = it->first + it->second;
+
+    Remove(it);
+
+    if (start < index) Add(start, index - start);
+    if (index + length < end) Add(index + length, end - index - length);
+  }
+
+  /*
+    Marks a range of used blocks as free
+  */
+  void Release(BlockIndex index, BlockIndex length) {
+
+    if (length <= 0) return;
+
+    auto it = Runs.upper_bound(index);
+
+    // merge with the run that follows
+    if (it != Runs.end() && it->first == index + length) {
+      length += it->second;
+      Remove(it++);
+    }
+
+    // merge with the run that comes before
+    if (it != Runs.begin()) {
+
+      auto before = prev(it);
+
+      if (before->first + before->second == index) {
+        index = before->first;
+        length += before->second;
+        Remove(before);
+      }
+    }
+
+    Add(index, length);
+  }
+};
+
+/*
+  The following struct types are placement policies of contiguous
+  allocation, they choose where a file of a given number of blocks is
+  placed. Every policy is told about blocks being reserved and released
+  so that it can keep its own index up to date, and Find returns the
+  first block of the chosen run or FAIL if no free run is long enough.
+*/
+
+/*
+  Places a file in the first run that is long enough
+*/
+struct FirstFit {
+
+  void Init(BlockIndex) {}
+  void Reserve(BlockIndex, BlockIndex) {}
+  void Release(BlockIndex, BlockIndex) {}
+
+  BlockIndex Find(FreeExtentTree& FreeSpace, BlockIndex length) {
+    return FreeSpace.FindFirstFit(length);
+  }
+};
+
+/*
+  Places a file in the first run that is long enough after the last
+  file placed, wrapping around to the start of the directory
+*/
+struct NextFit {
+
+  BlockIndex rover = 0;
+
+  void Init(BlockIndex) {
+    rover = 0;
+  }
+
+  void Reserve(BlockIndex, BlockIndex) {}
+  void Release(BlockIndex, BlockIndex) {}
+
+  BlockIndex Find(FreeExtentTree& FreeSpace, BlockIndex length) {
+
+    BlockIndex index = FreeSpace.FindFrom(rover, length);
+
+    if (index == FAIL) index = FreeSpace.FindFirstFit(length);
+
+    if (index != FAIL) rover = index + length;
+
+    return index;
+  }
+};
+
+/*
+  Places a file in the shortest run that is long enough, the first
+  one of them if there are several
+*/
+struct BestFit {
+
+  FreeExtentMap Free;
+
+  void Init(BlockIndex block_count) {
+    Free.Init(block_count);
+  }
+
+  void Reserve(BlockIndex index, BlockIndex length) {
+    Free.Reserve(index, length);
+  }
+
+  void Release(BlockIndex index, BlockIndex length) {
+    Free.Release(index, length);
+  }
+
+  BlockIndex Find(FreeExtentTree&, BlockIndex length) {
+
+    auto it = Free.BySize.lower_bound(make_pair(length, (BlockIndex) -1));
+
+    return it == Free.BySize.end() ? FAIL : it->second;
+  }
+};
+
+/*
+  Places a file at the start of the longest run, so that the space
+  left over is as long as possible
+*/
+struct WorstFit {
+
+  FreeExtentMap Free;
+
+  void Init(BlockIndex block_count) {
+    Free.Init(block_count);
+  }
+
+  void Reserve(BlockIndex index, BlockIndex length) {
+    Free.Reserve(index, length);
+  }
+
+  void Release(BlockIndex index, BlockIndex length) {
+    Free.Release(index, length);
+  }
+
+  BlockIndex Find(FreeExtentTree&, BlockIndex length) {
+
+    if (Free.BySize.empty() || Free.BySize.rbegin()->first < length) return FAIL;
+
+    // the longest run that comes first
+    BlockIndex longest = Free.BySize.rbegin()->first;
+
+    return Free.BySize.lower_bound(make_pair(longest, (BlockIndex) -1))->second;
+  }
+};
+
+/*
+  This struct type encapsulates a file system implemented with
+  Contiguous Allocation strategy. Where new files are placed is
+  decided by the Placement policy, one of the policies above. Its
+  attributes are:
+
+  block_size:       the size of each block in the directory
+  available_space:  stores the available space left in the directory it
+                    makes it easier and faster for several operations
+  Directory:        represents the blocks of the directory
+  FreeSpace:        indexes the free runs of Directory, it is kept in
+                    sync with every change done to Directory
+  Policy:           the placement policy, kept in sync with FreeSpace
+  compactions:      number of times ApplyCompaction has run
+  blocks_moved:     blocks relocated by ApplyCompaction
+  shift_moves:      blocks relocated by Shift
+  Table:            represents the Directory Table data structure
+  Logger:           used to LogIssue issues to standard error
+*/
+template<typename Placement>
+struct ContiguousAllocationT final : Allocation {
+
+  int block_size;
+  BlockIndex block_count;
+  BlockIndex available_space;
+  BlockStorage<int> Directory;
+  FreeExtentTree FreeSpace;
+  Placement Policy;
+  long long compactions;
+  long long blocks_moved;
+  long long shift_moves;
+  DirectoryTable Table;
+  GeneralLogger Logger;
+
+  ContiguousAllocationT(int _block_size, BlockIndex _block_count = MAX_BLOCKS) {
+
+    block_size = _block_size ;
+    block_count = _block_count;
+    available_space = block_count;
+    Directory = BlockStorage<int>(block_count);
+    FreeSpace = FreeExtentTree(block_count);
+    Policy.Init(block_count);
+    compactions = 0;
+    blocks_moved = 0;
+    shift_moves = 0;
+    Table = DirectoryTable();
+    Logger = GeneralLogger("ContiguousAllocation");
+  }
+
+  /*
+    Marks a range of blocks as used in FreeSpace and in the policy
+  */
+  void Reserve(BlockIndex index, BlockIndex length) {
+    FreeSpace.Reserve(index, length);
+    Policy.Reserve(index, length);
+  }
+
+  /*
+    Marks a range of blocks as free in FreeSpace and in the policy
+  */
+  void Release(BlockIndex index, BlockIndex length) {
+    FreeSpace.Release(index, length);
+    Policy.Release(index, length);
+  }
+
+  /*
+    Takes length of bytes and returns number of blocks required
+    to store these bytes, which is taken by dividing length by
+    block size and taking the ceil value
+  */
+  BlockIndex ByteToBlock(long long length) {
+
+    return (length + block_size - 1) / block_size;
+  }
+
+  /*
+    This function takes a file ID and a new index, and moves that file
+    to start from the new index. If while moving the file, some part of
+    the destination appears to be occupied, the operation fails.
+  */
+  int Move(int fileID, BlockIndex new_index) {
+
+    File* F = Table.Find(fileID);
+
+    if (F == NULL) {
+      Logger.LogIssue("Move", "Cannot Get file");
+      return FAIL;
+    }
+
+    BlockIndex old_index = F->index;
+
+    for (BlockIndex i = 0 ; i < F->block_len ; ++i) {
+
+      if (Directory[new_index + i] != EMPTY) {
+        Logger.LogIssue("Move", "Failed to Move because destination is occupied at %lld, moving from %lld to %lld, length: %lld", new_index + i, old_index, new_index, F->block_len);
+        Release(old_index, i);
+        Reserve(new_index, i);
+        return FAIL;
+      }
+
+      // move block by block, each block is moved directly
+      // from its old block to its new block
+
+      Directory[new_index + i] = fileID;
+      Directory[old_index + i] = EMPTY;
+    }
+
+    // the old range is released before the new one is reserved
+    // since both may overlap
+    Release(old_index, F->block_len);
+    Reserve(new_index, F->block_len);
+
+    blocks_moved += F->block_len;
+
+    // update index in Directory Table
+    F->index = new_index;
+
+    return SUCCESS;
+  }
+
+  /*
+    This function shifts the contents of a file from left to right by a certain
+    amount. It assumes that there is enough space on the right for shifting
+  */
+
+  int Shift(int fileID, BlockIndex amount) {
+
+    File* F = Table.Find(fileID);
+
+    if (F == NULL) {
+      Logger.LogIssue("Shift", "Issue in Getting file from table");
+      return FAIL;
+    }
+
+    BlockIndex index = F->index + F->block_len - 1;
+
+    for (BlockIndex i = index ; F->index <= i ; --i) {
+
+      if (Directory[i + amount] != EMPTY) {
+        Logger.LogIssue("Shift", "It is assumed that destination is empty, but it's not");
+        Release(i + 1, index - i);
+        Reserve(i + 1 + amount, index - i);
+        return FAIL;
+      }
+
+      Directory[i] = EMPTY;
+      Directory[i + amount] = fileID;
+    }
+
+    Release(F->index, F->block_len);
+    Reserve(F->index + amount, F->block_len);
+
+    shift_moves += F->block_len;
+
+    F->index += amount;
+
+    return SUCCESS;
+  }
+
+  /*
+    This function applies a compaction operation on the directory, this
+    operation is defined as follows, for all files stored in the directory
+    the files are shifted from high indexes to low indexes in a way such
+    that all blocks from the beginning of the directory are covered, leaving
+    all available empty space at the end of the directory, which makes enough
+    space for new additions or extensions.
+
+    The compaction is implemented to work in linear time in terms of directory
+    space. Also, it does not require any additional memory, as shifts of blocks
+    all are being done in place block by block.
+
+    A start index is given to the function because in some cases we will need to
+    apply compaction on some suffix of the directory, this is specifically in
+    cases where we apply compaction for extension, as after first compaction we
+    want to move the file we want to extend to this end, which leaves its space
+    empty, so we might want to do compaction again that case.
+  */
+  int ApplyCompaction(BlockIndex start_index) {
+
+    Logger.LogInfo("ApplyCompation", "Applying Compaction starting from %lld", start_index);
+
+    compactions++;
+
+    // last stores the index at which we expect to do
+    // our next insertion
+    BlockIndex last = start_index;
+
+    // every occupied block reached is the first block of a file, empty
+    // runs in between are skipped using the free bitmap
+    for (BlockIndex i = FreeSpace.Bits.FindNextUsed(start_index) ; i != FAIL ; ) {
+
+      int ID = Directory[i];
+      BlockIndex length = Table.Find(ID)->block_len;
+
+      if (last != i) {
+
+        // use move function to move the directory
+        int status = Move(ID, last);
+
+        if (status == FAIL) {
+          Logger.LogIssue("ApplyCompaction:", "Failed to compact due to Move issue");
+          return status;
+        }
+      }
+
+      // after moving a file, increase the last index
+      // by the length of the file, because that will
+      // be the place at which the next file should be
+      // inserted
+      last += length;
+      i = FreeSpace.Bits.FindNextUsed(i + length);
+    }
+
+    return SUCCESS;
+  }
+
+  /*
+    This function checks if it is possible to extend a file
+    to a certain region starting at the given index and has
+    length of the amount given
+  */
+  bool CanExtend(BlockIndex index, BlockIndex amount) {
+
+    if (block_count < index + amount) return false;
+
+    for (BlockIndex i = index ; i < index + amount ; ++i) {
+
+      if (Directory[i] != EMPTY) return false;
+    }
+
+    return true;
+  }
+
+  /*
+    This function attempts to find a space for a file of a
+    given block length, it returns the index of the spot chosen
+    by the placement policy among those that fit the required
+    number of blocks, or FAIL if there is none. Every policy
+    searches an index of free runs, so it takes logarithmic time
+    regardless of how full the directory is
+  */
+  BlockIndex FindAvailableSpace(BlockIndex block_num) {
+
+    return Policy.Find(FreeSpace, block_num);
+  }
+
+  /*
+    This function places a file in the directory by filling
+    Directory blocks with the fileID of the file being inserted
+  */
+  int Fill(int fileID, BlockIndex index, BlockIndex length) {
+
+    for (BlockIndex i = index ; i < index + length ; ++i) {
+
+      if (Directory[i] != EMPTY) {
+
+        Logger.LogIssue("Fill", "Cannot fill in already full slot at %lld, filling from %lld to %lld", i, index, index + length - 1);
+        Reserve(index, i - index);
+        return FAIL;
+      }
+
+      Directory[i] = fileID;
+    }
+
+    Reserve(index, length);
+
+    return SUCCESS;
+  }
+
+  /*
+    This function does the opposite of Fill, it makes directory blocks
+    occupied by some file empty. Spots being emptied are expected to
+    be occupied
+  */
+  int Empty(BlockIndex index, BlockIndex length) {
+
+    for (BlockIndex i = index ; i < index + length ; ++i) {
+
+      if (Directory[i] == EMPTY) {
+        Logger.LogIssue("Empty", "Attempting to empty an already Empty spot, this should not happen");
+        Release(index, i - index);
+        return FAIL;
+      }
+
+      Directory[i] = EMPTY;
+    }
+
+    Release(index, length);
+
+    return SUCCESS;
+  }
+
+  /*
+    This function creates a new file.
+  */
+  int CreateFile(int fileID, long long file_length) {
+
+    // if a file with such fileID exists, abort creation
+    if (Table.FileExists(fileID)) {
+      Logger.LogIssue("create_file", "Cannot create a file that already exists");
+      return FAIL;
+    }
+
+    BlockIndex block_num = ByteToBlock(file_length);
+
+    // if there is no enough space, reject creation
+    if (block_num > available_space) {
+      Logger.LogInfo("CreateFile", "Creation Rejected due to insufficient space");
+      return REJECT;
+    }
+
+    // find an available spot to insert the file
+    BlockIndex index = FindAvailableSpace(block_num);
+    int status;
+
+    // if no enough space is found, apply compaction to obtain space
+    // it is guaranteed to find enough space after compaction because
+    // we check at the beginning of total available space is enough
+    if (index == FAIL) {
+
+      Logger.LogInfo("CreateFile", "No Contiguous space was found, so next is compaction");
+
+      int status = ApplyCompaction(DIRECTORY_START);
+
+      if (status == FAIL) {
+        Logger.LogIssue("CreateFile", "Failed to create file due to compaction issue");
+        return status;
+      }
+
+      // this represents the first empty index after compaction
+      // it will for sure be the place at which we can insert the file
+      index = block_count - available_space;
+    }
+
+    // add file to Directory Table
+    status = Table.AddFile(fileID, File(index, block_num, file_length));
+
+    if (status == FAIL) {
+      return FAIL;
+    }
+
+    // fill in the blocks in Directory
+    status = Fill(fileID, index, block_num);
+
+    if (status == FAIL) {
+      Logger.LogIssue("CreateFile", "Creation Failed due to Fill Issue");
+      return FAIL;
+    }
+
+    // update available space
+    available_space -= block_num;
+
+    return SUCCESS;
+  }
+
+  /*
+    This function takes a file ID and a byte offset of that file, and
+    it returns the index of the block at which given offset of the
+    file is stored in the directory
+  */
+  BlockIndex Access(int fileID, long long byte_offset) {
+
+    File* F = Table.Find(fileID);
+
+    // if not such file exist, the operation fails
+    if (F == NULL) {
+      Logger.LogInfo("Access", "Cannot access file that does not exist");
+      return FAIL;
+    }
+
+    // if byte offset exceeds the file size, abort access operation
+    if (F->byte_len < byte_offset) {
+      Logger.LogInfo("Access", "Byte offset to be accessed exceeds actual file size");
+      return FAIL;
+    }
+
+    // see at which block of the file this offset exists
+    BlockIndex block_offset = ByteToBlock(byte_offset);
+
+    // starting from the file index, if we add block
+    // offset we will need to subtract 1 as the first
+    // index of the file already contains the first block
+    return F->index + block_offset - 1;
+  }
+
+  /*
+    This function takes a file and an extension amount, and it
+    extends the desired file by the number of blocks equal to
+    the given amount
+  */
+  int Extend(int fileID, BlockIndex extension_amount) {
+
+    File* F = Table.Find(fileID);
+
+    // if such file does not exist, the operation fails
+    if (F == NULL) {
+      Logger.LogIssue("Extend", "Cannot extend file that does not exist");
+      return FAIL;
+    }
+
+    // if no enough space for extension, operation is rejected
+    if (available_space < extension_amount) {
+      Logger.LogInfo("Extend", "Extension Rejected due to insufficient space");
+      return REJECT;
+    }
+
+    // if current space is enough to extend, extend it already
+    // if not, then apply compaction and extend
+    if (CanExtend(F->index + F->block_len, extension_amount)) {
+
+      int status = Fill(fileID, F->index + F->block_len, extension_amount);
+
+      if (status == FAIL) {
+        Logger.LogIssue("Extend", "Extension Failed due to Fill Issue while we can extend");
+        return status;
+      }
+
+    } else {
+
+      int status = ApplyCompaction(DIRECTORY_START);
+
+      if (status == FAIL) {
+        Logger.LogIssue("Extend", "Extension failed due to failure in compaction cannot extend");
+        return FAIL;
+      }
+
+      // compaction has moved the file, F points to its new place
+      BlockIndex stop_index = F->index + F->block_len - 1;
+      BlockIndex index = block_count - available_space - 1;
+      BlockIndex decrement = 1;
+
+      for (BlockIndex i = index ; stop_index < i ; i -= decrement) {
+
+        decrement = 1;
+
+        assert(Directory[i] != EMPTY);
+
+        int ID = Directory[i];
+
+        status = Shift(ID, extension_amount);
+
+        if (status == FAIL) {
+          Logger.LogIssue("Extend", "Cannot extend because cannot move after compacting");
+          return FAIL;
+        }
+
+        decrement = Table.Find(ID)->block_len;
+      }
+
+      status = Fill(fileID, F->index + F->block_len, extension_amount);
+
+      if (status == FAIL) {
+        Logger.LogIssue("Extend", "Extension failed due to fill Issue while we cannot extend");
+        return status;
+      }
+
+    }
+
+    // update Directory table with new block and byte lengths
+    F->block_len += extension_amount;
+    F->byte_len += block_size * extension_amount;
+
+    // update available_space
+    available_space -= extension_amount;
+
+    return SUCCESS;
+  }
+
+  /*
+    This function shrinks a file by a given amount. If shrink values
+    makes the number of blocks zero, then this file is removed from
+    the directory
+  */
+  int Shrink(int fileID, BlockIndex shrink_amount) {
+
+    File* F = Table.Find(fileID);
+
+    // if such file does not exists, the operation fails
+    if (F == NULL) {
+      Logger.LogIssue("Shrink", "Cannot shrink file that does not exist");
+      return FAIL;
+    }
+
+    // shirnk amount cannot be zero
+    if (shrink_amount == 0) {
+      Logger.LogIssue("Shrink", "Shrink amount cannot be equal to zero");
+      return FAIL;
+    }
+
+    // shrink amount cannot be greater than block length of file
+    if (F->block_len <= shrink_amount) {
+      Logger.LogIssue("Shrink", "Shrink aborted because shrink amount is greater than file size");
+      return FAIL;
+    }
+
+    BlockIndex blocks_left = F->block_len - shrink_amount;
+
+    // release the blocks of the directory
+    int status = Empty(F->index + blocks_left, shrink_amount);
+
+    if (status == FAIL) {
+      Logger.LogIssue("Shrink", "Shrink failed to issue in Empty");
+      return status;
+    }
+
+    // if blocks left for the file are equal to zero
+    // then remove this file from directory, otherwise,
+    // update the lengths in Directory Table
+    if (blocks_left == 0) {
+
+      status = Table.RemoveFile(fileID);
+
+      if (status == FAIL) {
+        Logger.LogIssue("Shrink", "Shrink failed due to issue in Remove File");
+        return FAIL;
+      }
+
+    } else {
+
+      F->block_len = blocks_left;
+      F->byte_len -= block_size * shrink_amount;
+    }
+
+    // update available space
+    available_space += shrink_amount;
+
+    return SUCCESS;
+  }
+
+  /*
+    Returns the average number of extents of the files in the
+    directory, which is always one for contiguous files
+  */
+  double ExtentsPerFile() {
+
+    return Table.empty() ? 0.0 : 1.0;
+  }
+
+  SpaceMetrics FreeMetrics() {
+
+    SpaceMetrics M;
+
+    M.SetFree(FreeSpace.ExtentCount(), FreeSpace.LargestExtent(), available_space);
+    M.compactions = compactions;
+    M.blocks_moved = blocks_moved;
+    M.shift_moves = shift_moves;
+
+    return M;
+  }
+
+  SpaceMetrics Metrics() {
+
+    SpaceMetrics M = FreeMetrics();
+
+    Table.SetFileMetrics(M, block_count - available_space, block_size, ExtentsPerFile());
+
+    return M;
+  }
+
+  /*
+    Prints a slice of the Directory, used for debugging
+  */
+  void PrintSlice(BlockIndex l, BlockIndex r) {
+
+    for (BlockIndex i = l ; i < r ; ++i) {
+      cout << i << " : " << Directory[i] << endl;
+    }
+  }
+
+  /*
+    Prints the Directory table contents, used for debugging
+  */
+  void ExploreTable() {
+
+    Table.ForEach([&](int fileID, File& F) {
+      cout << fileID << " : " << F.index << " " << F.block_len << " " << F.byte_len << endl;
+    });
+  }
+
+  /*
+    Returns a slice of directory as a vector
+  */
+  vector<int> Slice(BlockIndex l, BlockIndex r) {
+
+    vector<int> Res;
+
+    for (BlockIndex i = l ; i < r ; ++i)
+      Res.push_back(Directory[i]);
+
+    return Res;
+  }
+
+  /*
+    return map of Directory Table
+  */
+  unordered_map<int, File> ViewTable() {
+    return Table.ToMap();
+  }
+
+};
+
+typedef ContiguousAllocationT<FirstFit> ContiguousAllocation;
+
+/*
+  This struct type represents a file that is used in linked allocation.
+  Its attributes:
+
+  state: can be either empty or full
+  next:   stores the ID of the next
+  ID:     stored the ID of the linked file
+*/
+struct LinkedFile {
+
+  int state;
+  BlockIndex next;
+
+  LinkedFile(): next(END_OF_FILE), state(EMPTY) {}
+  LinkedFile(int _state): next(END_OF_FILE), state(_state) {}
+
+  /*
+    This function changes the state of the File block to occupied
+  */
+  void Fill(int ID) {
+    state = ID;
+  }
+
+  /*
+    This function changes the state of the File block to empty
+  */
+  void Empty() {
+    state = EMPTY;
+    next = END_OF_FILE;
+  }
+
+  /*
+    This function is used to update the next pointer
+  */
+  void UpdateNext(BlockIndex new_next) {
+    next = new_next;
+  }
+
+  /*
+    This function is used to update the state to a new given one.
+  */
+  void Updatestate(int new_state) {
+    state = new_state;
+  }
+
+};
+
+/*
+  This struct type encpsulates a file system implemented using
+  Linked Allocation. Its Attributes:
+
+  block_size:       the size of the block
+  available_space:  stores the number of blocks remaning empty
+  Table:            stores Directory Table
+  Directory:        stores list of Directory where each block is
+                    a LinkedFile instance, a zeroed LinkedFile is an
+                    empty block, so next is always set when filling
+  FreeBlocks:       one bit per block of Directory telling whether it is
+                    empty, it is kept in sync with the state of the blocks
+  jump_interval:    when not zero, an in-memory jump index is kept for
+                    every file, holding the location of every block whose
+                    position in the file is a multiple of jump_interval
+  Jumps:            the jump index of every file, it is only used to speed
+                    up Access and it is not charged against block capacity
+  group_size:       when zero, new blocks are always the lowest numbered
+                    free blocks. Otherwise blocks are split into groups of
+                    that many blocks as in ext, and new blocks are taken
+                    near a goal block, see Goal and FindAvailableSpace
+*/
+struct LinkedAllocation final : Allocation {
+
+  int block_size;
+  BlockIndex block_count;
+  BlockIndex available_space;
+  DirectoryTable Table;
+  BlockStorage<LinkedFile> Directory;
+  FreeBitmap FreeBlocks;
+  int jump_interval;
+  unordered_map<int, vector<BlockIndex>> Jumps;
+  BlockIndex group_size;
+  GeneralLogger Logger;
+
+  LinkedAllocation(int _block_size, BlockIndex _block_count = MAX_BLOCKS, int _jump_interval = 0, BlockIndex _group_size = 0) {
+    Table = DirectoryTable();
+    block_size = _block_size - POINTER_SIZE;
+    Logger = GeneralLogger("LinkedAllocation");
+    block_count = _block_count;
+    available_space = block_count;
+    Directory = BlockStorage<LinkedFile>(block_count);
+    FreeBlocks = FreeBitmap(block_count);
+    jump_interval = _jump_interval;
+    group_size = _group_size;
+  }
+
+  /*
+    This function records in the jump index of a file the blocks in space
+    whose position in the file is a multiple of the jump interval, given
+    that the first block of space is at position length of the file
+  */
+  void AddJumps(int fileID, BlockIndex length, vector<BlockIndex>& space) {
+
+    if (jump_interval == 0) return;
+
+    vector<BlockIndex>& List = Jumps[fileID];
+
+    // first position at or after length that is a multiple of the interval
+    BlockIndex first = (length + jump_interval - 1) / jump_interval * jump_interval;
+
+    for (BlockIndex i = first - length ; i < (BlockIndex) space.size() ; i += jump_interval) {
+      List.push_back(space[i]);
+    }
+  }
+
+  /*
+    Returns the memory used by the jump index in bytes
+  */
+  long long JumpIndexBytes() {
+
+    long long bytes = 0;
+
+    for (auto& el : Jumps) {
+      bytes += sizeof(el.first) + sizeof(el.second) + el.second.capacity() * sizeof(BlockIndex);
+    }
+
+    return bytes;
+  }
+
+  /*
+    Takes length of bytes and returns number of blocks required
+    to store these bytes, which is taken by dividing length by
+    block size and taking the ceil value
+  */
+  BlockIndex ByteToBlock(long long length) {
+
+    return (length + block_size - 1) / block_size;
+  }
+
+  /*
+    Returns the block that new blocks of a file should be placed near.
+    It is the block right after the tail of the file when extending it,
+    and for a new file (F being NULL) the first block of a group picked
+    by file ID, so that files are spread over the groups and keep room
+    to grow. It returns FAIL when blocks are not placed by goal
+  */
+  BlockIndex Goal(int fileID, File* F) {
+
+    if (group_size == 0) return FAIL;
+
+    if (F != NULL) return min(F->tail + 1, block_count - 1);
+
+    BlockIndex groups = (block_count + group_size - 1) / group_size;
+
+    return (unsigned) fileID % groups * group_size;
+  }
+
+  /*
+    This function attempts to find a space for a file of a
+    given block length, it returns a list of indexes which
+    are available to store the file. The free bitmap is used
+    so that full regions are skipped many blocks at a time.
+    Without a goal the lowest numbered free blocks are taken.
+    With one, free blocks are taken from the goal to the end of
+    its group, then from the rest of its group, then from the
+    following groups, so that a chain stays close to its tail
+  */
+  vector<BlockIndex> FindAvailableSpace(BlockIndex block_num, BlockIndex goal = FAIL) {
+
+    vector<BlockIndex> Res;
+
+    Res.reserve(block_num);
+
+    if (goal == FAIL) {
+      FreeBlocks.Collect(block_num, Res);
+      return Res;
+    }
+
+    BlockIndex start = goal / group_size * group_size;
+    BlockIndex end = min(start + group_size, block_count);
+
+    FreeBlocks.CollectRange(goal, end, block_num, Res);
+    FreeBlocks.CollectRange(start, goal, block_num, Res);
+    FreeBlocks.CollectRange(end, block_count, block_num, Res);
+    FreeBlocks.CollectRange(0, start, block_num, Res);
+
+    return Res;
+  }
+
+  /*
+    This function creates a new file.
+  */
+  int CreateFile(int fileID, long long file_length) {
+
+    // if such file exists, the operation fails
+    if (Table.FileExists(fileID)) {
+      Logger.LogIssue("create_file", "Cannot create a file that already exists");
+      return FAIL;
+    }
+
+    BlockIndex block_num = ByteToBlock(file_length);
+
+    // if no available space, the operation is rejected
+    if (block_num > available_space) {
+      Logger.LogInfo("CreateFile", "Creation Rejected due to insufficient space");
+      return REJECT;
+    }
+
+    vector<BlockIndex> space = FindAvailableSpace(block_num, Goal(fileID, NULL));
+
+    // ensure that we got same number of spaces as required
+    if ((BlockIndex) space.size() != block_num) {
+      Logger.LogIssue("CreateFile", "Number of Slots found does not match requested number.");
+      return FAIL;
+    }
+
+    // iterate over spaces and fill them
+    for (BlockIndex i = 0 ; i < block_num ; ++i) {
+
+      BlockIndex x = space[i];
+
+      // ensure that selected spaces are empty
+      if (Directory[x].state != EMPTY) {
+        Logger.LogIssue("CreateFile", "Expected an empty space in directory, but it is not empty");
+        return FAIL;
+      }
+
+      // fill block slot in directory
+      Directory[x].Fill(fileID);
+      FreeBlocks.Set(x, false);
+
+      // if not last block, update its next, otherwise
+      // it is the end of the file
+      if (i + 1 < block_num) {
+
+        BlockIndex next = space[i + 1];
+        Directory[x].UpdateNext(next);
+      } else {
+
+        Directory[x].UpdateNext(END_OF_FILE);
+      }
+    }
+
+    // add file to Directory Table, the last block found is its tail
+    int status = Table.AddFile(fileID, File(space[0], block_num, file_length, space.back()));
+
+    if (status == FAIL) {
+      return status;
+    }
+
+    AddJumps(fileID, 0, space);
+
+    // update available space
+    available_space -= block_num;
+
+    return SUCCESS;
+  }
+
+  /*
+    This function takes a file ID and a byte offset of that file, and
+    it returns the index of the block at which given offset of the
+    file is stored in the directory
+  */
+  BlockIndex Access(int fileID, long long byte_offset) {
+
+    File* F = Table.Find(fileID);
+
+    // if such file does not exist, operation fails
+    if (F == NULL) {
+      Logger.LogInfo("Access", "Cannot access file that does not exist");
+      return FAIL;
+    }
+
+    // if byte offset is larger the file byte length, operation fails
+    if (F->byte_len < byte_offset) {
+      Logger.LogInfo("Access", "Byte offset to be accessed exceeds actual file size");
+      return FAIL;
+    }
+
+    BlockIndex index = F->index;
+
+    // with a jump index, start from the closest indexed block before
+    // the required one, so at most jump_interval - 1 blocks are followed.
+    // If that block is not indexed, the chain is followed from the head
+    if (jump_interval != 0) {
+
+      BlockIndex steps = max(ByteToBlock(byte_offset) - 1, 0LL);
+
+      auto it = Jumps.find(fileID);
+
+      if (it != Jumps.end() && steps / jump_interval < (BlockIndex) it->second.size()) {
+        index = it->second[steps / jump_interval];
+        steps %= jump_interval;
+      }
+
+      for ( ; 0 < steps ; --steps) {
+        index = Directory[index].next;
+      }
+
+      return index;
+    }
+
+    // keep moving from the start until we reach the block
+    // which contains the required byte offset
+    while (block_size < byte_offset) {
+      byte_offset -= block_size;
+      index = Directory[index].next;
+    }
+
+    return index;
+  }
+
+  /*
+    This function takes a file and an extension amount, and it
+    extends the desired file by the number of blocks equal to
+    the given amount
+  */
+  int Extend(int fileID, BlockIndex extension_amount) {
+
+    File* F = Table.Find(fileID);
+
+    // if such file does not exist, operation fails
+    if (F == NULL) {
+      Logger.LogIssue("Extend", "Cannot extend file that does not exist");
+      return FAIL;
+    }
+
+    // if no available space of extension, reject
+    if (available_space < extension_amount) {
+      Logger.LogInfo("Extend", "Extension Rejected due to insufficient space");
+      return REJECT;
+    }
+
+    // find available indexes
+    vector<BlockIndex> space = FindAvailableSpace(extension_amount, Goal(fileID, F));
+
+    // ensure that space slots found match required
+    if ((BlockIndex) space.size() != extension_amount) {
+      Logger.LogIssue("Extend", "Number of Slots found does not match requested number.");
+      return FAIL;
+    }
+
+    // the last block is known from the Directory Table, so
+    // appending does not depend on the length of the file
+    BlockIndex index = F->tail;
+
+    // set the next of the last block to its new next which
+    // came to existence after extension
+    Directory[index].next = space[0];
+
+    for (BlockIndex i = 0 ; i < (BlockIndex) space.size() ; ++i) {
+
+      BlockIndex x = space[i];
+
+      // ensure chosen slot is empty
+      if (Directory[x].state != EMPTY) {
+        Logger.LogIssue("CreateFile", "Expected an empty space in directory, but it is not empty");
+        return FAIL;
+      }
+
+      Directory[x].Fill(fileID);
+      FreeBlocks.Set(x, false);
+
+      // if not last block set its next pointer
+      if (i + 1 < (BlockIndex) space.size()) {
+        BlockIndex next = space[i + 1];
+        Directory[x].UpdateNext(next);
+      } else {
+        Directory[x].UpdateNext(END_OF_FILE);
+      }
+    }
+
+    AddJumps(fileID, F->block_len, space);
+
+    // update lengths and tail in Directory table
+    F->block_len += extension_amount;
+    F->byte_len += block_size * extension_amount;
+    F->tail = space.back();
+
+    // update available space
+    available_space -= extension_amount;
+
+    return SUCCESS;
+  }
+
+  /*
+    This function shrinks a file by a given amount. If shrink values
+    makes the number of blocks zero, then this file is removed from
+    the directory
+  */
+  int Shrink(int fileID, BlockIndex shrink_amount) {
+
+    File* F = Table.Find(fileID);
+
+    // if such file does not exist, operation fails
+    if (F == NULL) {
+      Logger.LogIssue("Shrink", "Cannot shrink file that does not exist");
+      return FAIL;
+    }
+
+    // shrink amoutn cannot exceed current length
+    if (F->block_len <= shrink_amount) {
+      Logger.LogIssue("Shrink", "Shrink aborted because shrink amount is greater than file size");
+      return FAIL;
+    }
+
+    BlockIndex blocks_left = F->block_len - shrink_amount;
+
+    BlockIndex index = F->index;
+
+    // if blocks left is equal to zero, then file is removed from
+    // directory
+    if (blocks_left == 0) {
+
+      int status = Table.RemoveFile(fileID);
+
+      if (status == FAIL) return status;
+
+      Jumps.erase(fileID);
+
+    } else {
+
+      // update lengths in Directory table
+      F->block_len = blocks_left;
+      F->byte_len -= block_size * shrink_amount;
+
+      // drop the jump entries of the released blocks
+      auto it = Jumps.find(fileID);
+
+      if (it != Jumps.end()) {
+        it->second.resize(min((BlockIndex) it->second.size(), (blocks_left + jump_interval - 1) / jump_interval));
+      }
+
+      // find the index of the last block that remains after shrinking
+      for (BlockIndex i = 0 ; i < blocks_left - 1 ; ++i) {
+        index = Directory[index].next;
+      }
+
+      // set the next pointer of the last remaining block to end of file,
+      // it becomes the new tail of the file
+      BlockIndex next = Directory[index].next;
+      Directory[index].UpdateNext(END_OF_FILE);
+      F->tail = index;
+      index = next;
+    }
+
+    // remove all blocks that have been released after shrinking
+    while (index != END_OF_FILE) {
+      BlockIndex next = Directory[index].next;
+      Directory[index].Empty();
+      FreeBlocks.Set(index, true);
+      index = next;
+    }
+
+    // update available space
+    available_space += shrink_amount;
+
+    return SUCCESS;
+  }
+
+  SpaceMetrics FreeMetrics() {
+
+    SpaceMetrics M;
+    BlockIndex runs, largest;
+
+    FreeBlocks.RunStats(runs, largest);
+
+    M.SetFree(runs, largest, available_space);
+
+    return M;
+  }
+
+  SpaceMetrics Metrics() {
+
+    SpaceMetrics M = FreeMetrics();
+
+    Table.SetFileMetrics(M, block_count - available_space, block_size, ExtentsPerFile());
+    M.average_chain_distance = ChainDistance();
+
+    return M;
+  }
+
+  /*
+    Returns the average distance in blocks between consecutive blocks
+    of the chains of all files, which is one for chains that are fully
+    sequential and grows as chains scatter over the directory
+  */
+  double ChainDistance() {
+
+    double total = 0.0, links = 0.0;
+
+    Table.ForEach([&](int, File& F) {
+
+      for (BlockIndex index = F.index ; Directory[index].next != END_OF_FILE ; index = Directory[index].next) {
+        total += llabs(Directory[index].next - index);
+        links++;
+      }
+    });
+
+    return links == 0 ? 0.0 : total / links;
+  }
+
+  /*
+    Returns the average number of extents of the files in the directory,
+    a new extent starts whenever the next block of a chain is not the
+    block right after the current one
+  */
+  double ExtentsPerFile() {
+
+    if (Table.empty()) return 0.0;
+
+    double total = 0.0;
+
+    Table.ForEach([&](int, File& F) {
+
+      BlockIndex index = F.index;
+
+      total++;
+
+      while (Directory[index].next != END_OF_FILE) {
+
+        if (Directory[index].next != index + 1) total++;
+
+        index = Directory[index].next;
+      }
+    });
+
+    return total / Table.size();
+  }
+
+  /*
+    used for debugging
+  */
+  void PrintSlice(BlockIndex l, BlockIndex r) {
+
+    for (BlockIndex i = l ; i < r ; ++i) {
+      cout << Directory[i].state << endl;
+    }
+  }
+
+  /*
+    used for debugging
+  */
+  void ExploreTable() {
+
+    Table.ForEach([&](int fileID, File& F) {
+      cout << fileID << " : " << F.index << " " << F.block_len << " " << F.byte_len << endl;
+    });
+  }
+
+  /*
+    Returns a slice of directory as a vector
+  */
+  vector<int> Slice(BlockIndex l, BlockIndex r) {
+
+    vector<int> Res;
+
+    for (BlockIndex i = l ; i < r ; ++i)
+      Res.push_back(Directory[i].state);
+
+    return Res;
+  }
+
+  /*
+    return map of Directory Table
+  */
+  unordered_map<int, File> ViewTable() {
+    return Table.ToMap();
+  }
+
+};
+/*
+  This struct type encapsulates a file system implemented using Indexed
+  Allocation, modelled after the classic UNIX inode. Every file owns an
+  index block on the directory which stores pointers to the first data
+  blocks of the file (direct pointers), followed by one pointer to a single
+  indirect block (a block full of pointers to data blocks) and one pointer
+  to a double indirect block (a block full of pointers to single indirect
+  blocks). Index blocks are taken from the same directory as data blocks,
+  so the pointer overhead is paid in blocks of capacity. Its Attributes:
+
+  block_size:         the size of the block
+  pointers_per_block: number of pointers that fit in one index block
+  direct_count:       number of direct pointers in the index block of a
+                      file, the two remaining slots are the indirect ones
+  available_space:    stores the number of blocks remaning empty
+  Table:              stores Directory Table, the index of a file is the
+                      location of its index block
+  Directory:          stores for every block the ID of the file owning it
+  Slab:               the pointers of index blocks, pointers_per_block of
+                      them in every slot
+  SlotOf:             for every block, one more than the slot of Slab
+                      holding its pointers if it is an index block and 0
+                      otherwise, so that a new directory needs no setup
+  FreeSlots:          slots of Slab left by released index blocks, taken
+                      again before Slab grows
+  FreeBlocks:         one bit per block of Directory telling whether it
+                      is empty
+*/
+struct IndexedAllocation final : Allocation {
+
+  int block_size;
+  BlockIndex pointers_per_block;
+  BlockIndex direct_count;
+  BlockIndex block_count;
+  BlockIndex available_space;
+  DirectoryTable Table;
+  BlockStorage<int> Directory;
+  vector<BlockIndex> Slab;
+  BlockStorage<BlockIndex> SlotOf;
+  vector<BlockIndex> FreeSlots;
+  FreeBitmap FreeBlocks;
+  GeneralLogger Logger;
+
+  IndexedAllocation(int _block_size, BlockIndex _block_count = MAX_BLOCKS) {
+    Table = DirectoryTable();
+    block_size = _block_size;
+    pointers_per_block = max(block_size / POINTER_SIZE, 2);
+    direct_count = pointers_per_block - 2;
+    Logger = GeneralLogger("IndexedAllocation");
+    block_count = _block_count;
+    available_space = block_count;
+    Directory = BlockStorage<int>(block_count);
+    SlotOf = BlockStorage<BlockIndex>(block_count);
+    FreeBlocks = FreeBitmap(block_count);
+  }
+
+  /*
+    Takes length of bytes and returns number of blocks required
+    to store these bytes, which is taken by dividing length by
+    block size and taking the ceil value
+  */
+  BlockIndex ByteToBlock(long long length) {
+
+    return (length + block_size - 1) / block_size;
+  }
+
+  /*
+    Returns the largest number of data blocks a single file can
+    address through its index block
+  */
+  BlockIndex MaxFileBlocks() {
+
+    return direct_count + pointers_per_block + pointers_per_block * pointers_per_block;
+  }
+
+  /*
+    Returns the number of index blocks, including the index block of
+    the file itself, needed by a file of data_blocks data blocks
+  */
+  BlockIndex IndexBlockCount(BlockIndex data_blocks) {
+
+    BlockIndex count = 1;
+
+    if (direct_count < data_blocks) count++;
+
+    BlockIndex in_double = data_blocks - direct_count - pointers_per_block;
+
+    // the double indirect block and the single indirect
+    // blocks it points to
+    if (0 < in_double) count += 1 + (in_double + pointers_per_block - 1) / pointers_per_block;
+
+    return count;
+  }
+
+  /*
+    Returns the pointers stored in block x when it is an index block.
+    Slab moves when it grows, so the pointers returned must be looked up
+    again once another index block is taken
+  */
+  BlockIndex* PointersOf(BlockIndex x) {
+
+    return &Slab[(SlotOf[x] - 1) * pointers_per_block];
+  }
+
+  /*
+    Marks a free block as owned by the given file, if the block is going
+    to be used as an index block, it gets a slot of Slab with its
+    pointers initialized
+  */
+  void TakeBlock(int fileID, BlockIndex x, bool index_block) {
+
+    Directory[x] = fileID;
+    FreeBlocks.Set(x, false);
+
+    if (!index_block) return;
+
+    if (FreeSlots.empty()) {
+      FreeSlots.push_back(Slab.size() / pointers_per_block);
+      Slab.resize(Slab.size() + pointers_per_block);
+    }
+
+    SlotOf[x] = FreeSlots.back() + 1;
+    FreeSlots.pop_back();
+
+    fill_n(PointersOf(x), pointers_per_block, (BlockIndex) END_OF_FILE);
+  }
+
+  /*
+    Marks a block as empty, giving back its slot of Slab if it was an
+    index block
+  */
+  void ReleaseBlock(BlockIndex x) {
+
+    Directory[x] = EMPTY;
+    FreeBlocks.Set(x, true);
+
+    if (SlotOf[x] != 0) {
+      FreeSlots.push_back(SlotOf[x] - 1);
+      SlotOf[x] = 0;
+    }
+  }
+
+  /*
+    This function resolves the data block at the given logical position
+    of the file whose index block is root. It follows at most three
+    pointers, so it runs in time independent of the file length. It
+    returns FAIL if the position is past the blocks of the file, which
+    with block sizes that leave no direct pointers can happen even for
+    the first block
+  */
+  BlockIndex Resolve(BlockIndex root, BlockIndex logical) {
+
+    BlockIndex* Root = PointersOf(root);
+
+    if (logical < direct_count) return Root[logical];
+
+    logical -= direct_count;
+
+    BlockIndex single;
+
+    if (logical < pointers_per_block) {
+
+      single = Root[direct_count];
+
+    } else {
+
+      logical -= pointers_per_block;
+
+      BlockIndex dbl = Root[direct_count + 1];
+
+      if (dbl == END_OF_FILE) return FAIL;
+
+      single = PointersOf(dbl)[logical / pointers_per_block];
+      logical %= pointers_per_block;
+    }
+
+    if (single == END_OF_FILE) return FAIL;
+
+    return PointersOf(single)[logical];
+  }
+
+  /*
+    This function appends data blocks to the file whose index block is
+    root and which currently has length data blocks. Blocks are taken
+    in order from space starting at position next, and indirect blocks
+    are taken from there too whenever a new one is needed.
+  */
+  void Append(int fileID, BlockIndex root, BlockIndex length, BlockIndex count, vector<BlockIndex>& space, size_t& next) {
+
+    for (BlockIndex logical = length ; logical < length + count ; ++logical) {
+
+      BlockIndex* slot;
+
+      if (logical < direct_count) {
+
+        slot = &PointersOf(root)[logical];
+
+      } else if (logical < direct_count + pointers_per_block) {
+
+        BlockIndex offset = logical - direct_count;
+
+        // the first block past the direct ones needs the single indirect block
+        if (offset == 0) {
+          TakeBlock(fileID, space[next], true);
+          PointersOf(root)[direct_count] = space[next++];
+        }
+
+        slot = &PointersOf(PointersOf(root)[direct_count])[offset];
+
+      } else {
+
+        BlockIndex offset = logical - direct_count - pointers_per_block;
+
+        if (offset == 0) {
+          TakeBlock(fileID, space[next], true);
+          PointersOf(root)[direct_count + 1] = space[next++];
+        }
+
+        BlockIndex dbl = PointersOf(root)[direct_count + 1];
+
+        // every pointers_per_block blocks a new single indirect block is needed
+        if (offset % pointers_per_block == 0) {
+          TakeBlock(fileID, space[next], true);
+          PointersOf(dbl)[offset / pointers_per_block] = space[next++];
+        }
+
+        slot = &PointersOf(PointersOf(dbl)[offset / pointers_per_block])[offset % pointers_per_block];
+      }
+
+      *slot = space[next];
+      TakeBlock(fileID, space[next++], false);
+    }
+  }
+
+  /*
+    This function removes the last count data blocks of the file whose
+    index block is root and which currently has length data blocks,
+    releasing indirect blocks once they no longer point to anything.
+    It returns the number of blocks released.
+  */
+  BlockIndex Truncate(BlockIndex root, BlockIndex length, BlockIndex count) {
+
+    BlockIndex released = 0;
+    BlockIndex* Root = PointersOf(root);
+
+    for (BlockIndex logical = length - 1 ; length - count <= logical ; --logical) {
+
+      ReleaseBlock(Resolve(root, logical));
+      released++;
+
+      if (logical < direct_count) {
+
+        Root[logical] = END_OF_FILE;
+
+      } else if (logical < direct_count + pointers_per_block) {
+
+        BlockIndex offset = logical - direct_count;
+        BlockIndex single = Root[direct_count];
+
+        PointersOf(single)[offset] = END_OF_FILE;
+
+        if (offset == 0) {
+          ReleaseBlock(single);
+          Root[direct_count] = END_OF_FILE;
+          released++;
+        }
+
+      } else {
+
+        BlockIndex offset = logical - direct_count - pointers_per_block;
+        BlockIndex dbl = Root[direct_count + 1];
+        BlockIndex single = PointersOf(dbl)[offset / pointers_per_block];
+
+        PointersOf(single)[offset % pointers_per_block] = END_OF_FILE;
+
+        if (offset % pointers_per_block == 0) {
+          ReleaseBlock(single);
+          PointersOf(dbl)[offset / pointers_per_block] = END_OF_FILE;
+          released++;
+        }
+
+        if (offset == 0) {
+          ReleaseBlock(dbl);
+          Root[direct_count + 1] = END_OF_FILE;
+          released++;
+        }
+      }
+    }
+
+    return released;
+  }
+
+  /*
+    This function creates a new file.
+  */
+  int CreateFile(int fileID, long long file_length) {
+
+    // if such file exists, the operation fails
+    if (Table.FileExists(fileID)) {
+      Logger.LogIssue("create_file", "Cannot create a file that already exists");
+      return FAIL;
+    }
+
+    BlockIndex block_num = ByteToBlock(file_length);
+
+    // a file larger than what its index block can address is rejected
+    if (MaxFileBlocks() < block_num) {
+      Logger.LogInfo("CreateFile", "Creation Rejected because file exceeds maximum indexed size");
+      return REJECT;
+    }
+
+    BlockIndex total = block_num + IndexBlockCount(block_num);
+
+    // if no available space, the operation is rejected
+    if (total > available_space) {
+      Logger.LogInfo("CreateFile", "Creation Rejected due to insufficient space");
+      return REJECT;
+    }
+
+    vector<BlockIndex> space;
+    space.reserve(total);
+    FreeBlocks.Collect(total, space);
+
+    // ensure that we got same number of spaces as required
+    if ((BlockIndex) space.size() != total) {
+      Logger.LogIssue("CreateFile", "Number of Slots found does not match requested number.");
+      return FAIL;
+    }
+
+    // the first block found holds the index block of the file
+    size_t next = 0;
+    BlockIndex root = space[next++];
+
+    TakeBlock(fileID, root, true);
+    Append(fileID, root, 0, block_num, space, next);
+
+    // add file to Directory Table
+    int status = Table.AddFile(fileID, File(root, block_num, file_length));
+
+    if (status == FAIL) {
+      return status;
+    }
+
+    // update available space
+    available_space -= total;
+
+    return SUCCESS;
+  }
+
+  /*
+    This function takes a file ID and a byte offset of that file, and
+    it returns the index of the block at which given offset of the
+    file is stored in the directory
+  */
+  BlockIndex Access(int fileID, long long byte_offset) {
+
+    File* F = Table.Find(fileID);
+
+    // if such file does not exist, operation fails
+    if (F == NULL) {
+      Logger.LogInfo("Access", "Cannot access file that does not exist");
+      return FAIL;
+    }
+
+    // if byte offset is larger the file byte length, operation fails
+    if (F->byte_len < byte_offset) {
+      Logger.LogInfo("Access", "Byte offset to be accessed exceeds actual file size");
+      return FAIL;
+    }
+
+    // a file of no bytes has no data block to resolve
+    if (F->block_len == 0) {
+      Logger.LogInfo("Access", "Cannot access a file that has no blocks");
+      return FAIL;
+    }
+
+    // offsets up to block_size are in the first block, the same
+    // way as they are counted in linked allocation
+    BlockIndex logical = max(ByteToBlock(byte_offset) - 1, 0LL);
+
+    return Resolve(F->index, logical);
+  }
+
+  /*
+    This function takes a file and an extension amount, and it
+    extends the desired file by the number of blocks equal to
+    the given amount
+  */
+  int Extend(int fileID, BlockIndex extension_amount) {
+
+    File* F = Table.Find(fileID);
+
+    // if such file does not exist, operation fails
+    if (F == NULL) {
+      Logger.LogIssue("Extend", "Cannot extend file that does not exist");
+      return FAIL;
+    }
+
+    BlockIndex block_num = F->block_len + extension_amount;
+
+    if (MaxFileBlocks() < block_num) {
+      Logger.LogInfo("Extend", "Extension Rejected because file exceeds maximum indexed size");
+      return REJECT;
+    }
+
+    // new indirect blocks may be needed on top of the data blocks
+    BlockIndex total = extension_amount + IndexBlockCount(block_num) - IndexBlockCount(F->block_len);
+
+    // if no available space of extension, reject
+    if (available_space < total) {
+      Logger.LogInfo("Extend", "Extension Rejected due to insufficient space");
+      return REJECT;
+    }
+
+    vector<BlockIndex> space;
+    space.reserve(total);
+    FreeBlocks.Collect(total, space);
+
+    // ensure that space slots found match required
+    if ((BlockIndex) space.size() != total) {
+      Logger.LogIssue("Extend", "Number of Slots found does not match requested number.");
+      return FAIL;
+    }
+
+    size_t next = 0;
+
+    Append(fileID, F->index, F->block_len, extension_amount, space, next);
+
+    // update lengths in Directory table
+    F->block_len = block_num;
+    F->byte_len += block_size * extension_amount;
+
+    // update available space
+    available_space -= total;
+
+    return SUCCESS;
   }
 
   /*
-    This function creates a new file.
+    This function shrinks a file by a given amount. Index blocks that
+    no longer point to any block are released along with data blocks
   */
-  int CreateFile(int fileID, int file_length) {
+  int Shrink(int fileID, BlockIndex shrink_amount) {
 
-    // if a file with such fileID exists, abort creation
-    if (Table.FileExists(fileID)) {
-      Logger.LogIssue("create_file", "Cannot create a file that already exists");
+    File* F = Table.Find(fileID);
+
+    // if such file does not exist, operation fails
+    if (F == NULL) {
+      Logger.LogIssue("Shrink", "Cannot shrink file that does not exist");
       return FAIL;
     }
 
-    int block_num = ByteToBlock(file_length);
+    // shrink amount cannot exceed current length
+    if (F->block_len <= shrink_amount) {
+      Logger.LogIssue("Shrink", "Shrink aborted because shrink amount is greater than file size");
+      return FAIL;
+    }
 
-    // if there is no enough space, reject creation
-    if (block_num > available_space) {
-      Logger.LogInfo("CreateFile", "Creation Rejected due to insufficient space");
-      return REJECT;
+    BlockIndex released = Truncate(F->index, F->block_len, shrink_amount);
+
+    // update lengths in Directory table
+    F->block_len -= shrink_amount;
+    F->byte_len -= block_size * shrink_amount;
+
+    // update available space
+    available_space += released;
+
+    return SUCCESS;
+  }
+
+  SpaceMetrics FreeMetrics() {
+
+    SpaceMetrics M;
+    BlockIndex runs, largest;
+
+    FreeBlocks.RunStats(runs, largest);
+
+    M.SetFree(runs, largest, available_space);
+
+    return M;
+  }
+
+  SpaceMetrics Metrics() {
+
+    SpaceMetrics M = FreeMetrics();
+
+    Table.SetFileMetrics(M, block_count - available_space, block_size, ExtentsPerFile());
+
+    return M;
+  }
+
+  /*
+    Returns the average number of extents of the files in the directory,
+    counting the data blocks of every file in logical order
+  */
+  double ExtentsPerFile() {
+
+    if (Table.empty()) return 0.0;
+
+    double total = 0.0;
+
+    Table.ForEach([&](int, File& F) {
+
+      for (BlockIndex logical = 0 ; logical < F.block_len ; ++logical) {
+
+        if (logical == 0 || Resolve(F.index, logical) != Resolve(F.index, logical - 1) + 1) total++;
+      }
+    });
+
+    return total / Table.size();
+  }
+
+  /*
+    Returns a slice of directory as a vector
+  */
+  vector<int> Slice(BlockIndex l, BlockIndex r) {
+
+    vector<int> Res;
+
+    for (BlockIndex i = l ; i < r ; ++i)
+      Res.push_back(Directory[i]);
+
+    return Res;
+  }
+
+  /*
+    return map of Directory Table
+  */
+  unordered_map<int, File> ViewTable() {
+    return Table.ToMap();
+  }
+
+};
+
+/*
+  This struct type describes a run of blocks of a file that are stored
+  next to each other. Its attributes:
+
+  logical:  position within the file of the first block of the run
+  physical: index in the directory of the first block of the run
+  length:   number of blocks in the run
+*/
+struct Extent {
+
+  BlockIndex logical;
+  BlockIndex physical;
+  BlockIndex length;
+
+  Extent() {}
+  Extent(BlockIndex logical, BlockIndex physical, BlockIndex length): logical(logical), physical(physical), length(length) {}
+};
+
+/*
+  This struct type encapsulates a file system implemented using Extent
+  based allocation, the way ext4 stores files. Every file keeps a sorted
+  array of extents mapping its logical blocks to runs of physical blocks.
+  Files are placed in a single extent whenever a free run is long enough,
+  and extending a file grows its last extent in place as long as the
+  blocks following it are free, so no compaction or per block chains are
+  needed. Its Attributes:
+
+  block_size:       the size of the block
+  available_space:  stores the number of blocks remaning empty
+  Table:            stores Directory Table, the index of a file is the
+                    first block of its first extent
+  Directory:        stores for every block the ID of the file owning it
+  FreeSpace:        indexes the free runs of Directory
+  Extents:          the extents of every file sorted by logical block
+*/
+struct ExtentAllocation final : Allocation {
+
+  int block_size;
+  BlockIndex block_count;
+  BlockIndex available_space;
+  DirectoryTable Table;
+  BlockStorage<int> Directory;
+  FreeExtentTree FreeSpace;
+  unordered_map<int, vector<Extent>> Extents;
+  GeneralLogger Logger;
+
+  ExtentAllocation(int _block_size, BlockIndex _block_count = MAX_BLOCKS) {
+    Table = DirectoryTable();
+    block_size = _block_size;
+    Logger = GeneralLogger("ExtentAllocation");
+    block_count = _block_count;
+    available_space = block_count;
+    Directory = BlockStorage<int>(block_count);
+    FreeSpace = FreeExtentTree(block_count);
+  }
+
+  /*
+    Takes length of bytes and returns number of blocks required
+    to store these bytes, which is taken by dividing length by
+    block size and taking the ceil value
+  */
+  BlockIndex ByteToBlock(long long length) {
+
+    return (length + block_size - 1) / block_size;
+  }
+
+  /*
+    Marks a run of free blocks as owned by the given file
+  */
+  void Fill(int fileID, BlockIndex index, BlockIndex length) {
+
+    for (BlockIndex i = index ; i < index + length ; ++i) {
+      Directory[i] = fileID;
     }
 
-    // find an available spot to insert the file
-    int index = FindAvailableSpace(block_num), status;
+    FreeSpace.Reserve(index, length);
+  }
 
-    // if no enough space is found, apply compaction to obtain space
-    // it is guaranteed to find enough space after compaction because
-    // we check at the beginning of total available space is enough
-    if (index == FAIL) {
+  /*
+    Marks a run of blocks as empty
+  */
+  void Empty(BlockIndex index, BlockIndex length) {
 
-      Logger.LogInfo("CreateFile", "No Contiguous space was found, so next is compaction");
+    for (BlockIndex i = index ; i < index + length ; ++i) {
+      Directory[i] = EMPTY;
+    }
 
-      int status = ApplyCompaction(DIRECTORY_START);
+    FreeSpace.Release(index, length);
+  }
 
-      if (status == FAIL) {
-        Logger.LogIssue("CreateFile", "Failed to create file due to compaction issue");
-        return status;
+  /*
+    This function appends block_num blocks to the given extent list, the
+    caller ensures enough free blocks exist. A single free run is used if
+    one is long enough, otherwise the largest free runs are taken one
+    after another so that the file ends up with as few extents as possible
+  */
+  void Allocate(int fileID, vector<Extent>& List, BlockIndex logical, BlockIndex block_num) {
+
+    while (0 < block_num) {
+
+      BlockIndex length = block_num;
+      BlockIndex index = FreeSpace.FindFirstFit(length);
+
+      if (index == FAIL) {
+        length = FreeSpace.LargestExtent();
+        index = FreeSpace.FindFirstFit(length);
       }
 
-      // this represents the first empty index after compaction
-      // it will for sure be the place at which we can insert the file
-      index = MAX_BLOCKS - available_space;
+      Fill(fileID, index, length);
+      List.push_back(Extent(logical, index, length));
+
+      logical += length;
+      block_num -= length;
     }
+  }
 
-    // add file to Directory Table
-    status = Table.AddFile(fileID, File(index, block_num, file_length));
+  /*
+    This function creates a new file.
+  */
+  int CreateFile(int fileID, long long file_length) {
 
-    if (status == FAIL) {
+    // if such file exists, the operation fails
+    if (Table.FileExists(fileID)) {
+      Logger.LogIssue("create_file", "Cannot create a file that already exists");
       return FAIL;
     }
 
-    // fill in the blocks in Directory
-    status = Fill(fileID, index, block_num);
+    BlockIndex block_num = ByteToBlock(file_length);
+
+    // if no available space, the operation is rejected
+    if (block_num > available_space) {
+      Logger.LogInfo("CreateFile", "Creation Rejected due to insufficient space");
+      return REJECT;
+    }
+
+    vector<Extent>& List = Extents[fileID];
+
+    Allocate(fileID, List, 0, block_num);
+
+    BlockIndex index = List.empty() ? END_OF_FILE : List[0].physical;
+
+    // add file to Directory Table
+    int status = Table.AddFile(fileID, File(index, block_num, file_length));
 
     if (status == FAIL) {
-      Logger.LogIssue("CreateFile", "Creation Failed due to Fill Issue");
-      return FAIL;
+      return status;
     }
 
     // update available space
@@ -588,221 +3082,188 @@ struct ContiguousAllocation : Allocation {
   /*
     This function takes a file ID and a byte offset of that file, and
     it returns the index of the block at which given offset of the
-    file is stored in the directory
+    file is stored in the directory. The extent holding the offset is
+    found with a binary search over the extents of the file
   */
-  int Access(int fileID, int byte_offset) {
+  BlockIndex Access(int fileID, long long byte_offset) {
 
-    // if not such file exist, the operation fails
-    if (!Table.FileExists(fileID)) {
+    File* F = Table.Find(fileID);
+
+    // if such file does not exist, operation fails
+    if (F == NULL) {
       Logger.LogInfo("Access", "Cannot access file that does not exist");
       return FAIL;
     }
 
-    File F = Table.GetFile(fileID);
-
-    if (F == NullFile) {
+    // if byte offset is larger the file byte length, operation fails
+    if (F->byte_len < byte_offset) {
+      Logger.LogInfo("Access", "Byte offset to be accessed exceeds actual file size");
       return FAIL;
     }
 
-    // if byte offset exceeds the file size, abort access operation
-    if (F.byte_len < byte_offset) {
-      Logger.LogInfo("Access", "Byte offset to be accessed exceeds actual file size");
+    BlockIndex logical = max(ByteToBlock(byte_offset) - 1, 0LL);
+
+    vector<Extent>& List = Extents[fileID];
+
+    if (List.empty()) {
       return FAIL;
     }
 
-    // see at which block of the file this offset exists
-    int block_offset = ByteToBlock(byte_offset);
+    // find the last extent starting at or before the logical block
+    int lo = 0, hi = List.size() - 1;
 
-    // starting from the file index, if we add block
-    // offset we will need to subtract 1 as the first
-    // index of the file already contains the first block
-    return F.index + block_offset - 1;
+    while (lo < hi) {
+
+      int mid = (lo + hi + 1) / 2;
+
+      if (List[mid].logical <= logical) lo = mid;
+      else hi = mid - 1;
+    }
+
+    return List[lo].physical + logical - List[lo].logical;
   }
 
   /*
     This function takes a file and an extension amount, and it
     extends the desired file by the number of blocks equal to
-    the given amount
+    the given amount. The last extent grows in place over the free
+    blocks that follow it, and new extents are only added for the
+    remaining blocks
   */
-  int Extend(int fileID, int extension_amount) {
+  int Extend(int fileID, BlockIndex extension_amount) {
 
-    // if such file does not exist, the operation fails
-    if (!Table.FileExists(fileID)) {
+    File* F = Table.Find(fileID);
+
+    // if such file does not exist, operation fails
+    if (F == NULL) {
       Logger.LogIssue("Extend", "Cannot extend file that does not exist");
       return FAIL;
     }
 
-    // if no enough space for extension, operation is rejected
+    // if no available space of extension, reject
     if (available_space < extension_amount) {
       Logger.LogInfo("Extend", "Extension Rejected due to insufficient space");
       return REJECT;
     }
 
-    File F = Table.GetFile(fileID);
-
-    if (F == NullFile) {
-      Logger.LogIssue("Extend", "Cannot Get File");
-      return FAIL;
-    }
-
-    // if current space is enough to extend, extend it already
-    // if not, then apply compaction and extend
-    if (CanExtend(F.index + F.block_len, extension_amount)) {
-
-      int status = Fill(fileID, F.index + F.block_len, extension_amount);
-
-      if (status == FAIL) {
-        Logger.LogIssue("Extend", "Extension Failed due to Fill Issue while we can extend");
-        return status;
-      }
-
-    } else {
-
-      int status = ApplyCompaction(DIRECTORY_START);
-
-      if (status == FAIL) {
-        Logger.LogIssue("Extend", "Extension failed due to failure in compaction cannot extend");
-        return FAIL;
-      }
-
-      File Fi = Table.GetFile(fileID);
-
-      int stop_index = Fi.index + Fi.block_len - 1;
-      int index = MAX_BLOCKS - available_space - 1;
-      int decrement = 1;
-
-      for (int i = index ; stop_index < i ; i -= decrement) {
-
-        decrement = 1;
-
-        assert(Directory[i] != EMPTY);
-
-        int ID = Directory[i];
+    vector<Extent>& List = Extents[fileID];
+    BlockIndex remaining = extension_amount;
 
-        status = Shift(ID, extension_amount);
+    if (!List.empty()) {
 
-        if (status == FAIL) {
-          Logger.LogIssue("Extend", "Cannot extend because cannot move after compacting");
-          return FAIL;
-        }
+      Extent& Last = List.back();
+      BlockIndex end = Last.physical + Last.length;
 
-        decrement = Table.GetFile(ID).block_len;
-      }
+      // count the free blocks that directly follow the last extent
+      BlockIndex used = FreeSpace.Bits.FindNextUsed(end);
+      BlockIndex room = end < block_count ? (used == FAIL ? block_count : used) - end : 0;
+      BlockIndex grow = min(room, remaining);
 
-      status = Fill(fileID, Fi.index + Fi.block_len, extension_amount);
+      Fill(fileID, end, grow);
+      Last.length += grow;
+      remaining -= grow;
+    }
 
-      if (status == FAIL) {
-        Logger.LogIssue("Extend", "Extension failed due to fill Issue while we cannot extend");
-        return status;
-      }
+    Allocate(fileID, List, F->block_len + extension_amount - remaining, remaining);
 
-    }
+    if (F->index == END_OF_FILE && !List.empty()) F->index = List[0].physical;
 
-    // update Directory table with new block and byte lengths
-    Table.UpdateBlockLen(fileID, F.block_len + extension_amount);
-    Table.UpdateByteLen(fileID, F.byte_len + block_size * extension_amount);
+    // update lengths in Directory table
+    F->block_len += extension_amount;
+    F->byte_len += block_size * extension_amount;
 
-    // update available_space
+    // update available space
     available_space -= extension_amount;
 
     return SUCCESS;
   }
 
   /*
-    This function shrinks a file by a given amount. If shrink values
-    makes the number of blocks zero, then this file is removed from
-    the directory
+    This function shrinks a file by a given amount, releasing blocks
+    from the end of its last extents
   */
-  int Shrink(int fileID, int shrink_amount) {
+  int Shrink(int fileID, BlockIndex shrink_amount) {
 
-    // if such file does not exists, the operation fails
-    if (!Table.FileExists(fileID)) {
-      Logger.LogIssue("Shrink", "Cannot shrink file that does not exist");
-      return FAIL;
-    }
-
-    // shirnk amount cannot be zero
-    if (shrink_amount == 0) {
-      Logger.LogIssue("Shrink", "Shrink amount cannot be equal to zero");
-      return FAIL;
-    }
+    File* F = Table.Find(fileID);
 
-    File F = Table.GetFile(fileID);
-
-    if (F == NullFile) {
-      Logger.LogIssue("Shrink", "Cannot Get File");
+    // if such file does not exist, operation fails
+    if (F == NULL) {
+      Logger.LogIssue("Shrink", "Cannot shrink file that does not exist");
       return FAIL;
     }
 
-    // shrink amount cannot be greater than block length of file
-    if (F.block_len <= shrink_amount) {
+    // shrink amount cannot exceed current length
+    if (F->block_len <= shrink_amount) {
       Logger.LogIssue("Shrink", "Shrink aborted because shrink amount is greater than file size");
       return FAIL;
     }
 
-    int blocks_left = F.block_len - shrink_amount;
-
-    // release the blocks of the directory
-    int status = Empty(F.index + blocks_left, shrink_amount);
-
-    if (status == FAIL) {
-      Logger.LogIssue("Shrink", "Shrink failed to issue in Empty");
-      return status;
-    }
-
-    // if blocks left for the file are equal to zero
-    // then remove this file from directory, otherwise,
-    // update the lengths in Directory Table
-    if (blocks_left == 0) {
+    vector<Extent>& List = Extents[fileID];
 
-      status = Table.RemoveFile(fileID);
+    for (BlockIndex remaining = shrink_amount ; 0 < remaining ; ) {
 
-      if (status == FAIL) {
-        Logger.LogIssue("Shrink", "Shrink failed due to issue in Remove File");
-        return FAIL;
-      }
+      Extent& Last = List.back();
+      BlockIndex cut = min(Last.length, remaining);
 
-    } else {
+      Empty(Last.physical + Last.length - cut, cut);
+      Last.length -= cut;
+      remaining -= cut;
 
-      Table.UpdateBlockLen(fileID, blocks_left);
-      Table.UpdateByteLen(fileID, F.byte_len - block_size * shrink_amount);
+      if (Last.length == 0) List.pop_back();
     }
 
+    // update lengths in Directory table
+    F->block_len -= shrink_amount;
+    F->byte_len -= block_size * shrink_amount;
+
     // update available space
     available_space += shrink_amount;
 
     return SUCCESS;
   }
 
-  /*
-    Prints a slice of the Directory, used for debugging
-  */
-  void PrintSlice(int l, int r) {
+  SpaceMetrics FreeMetrics() {
 
-    for (int i = l ; i < r ; ++i) {
-      cout << i << " : " << Directory[i] << endl;
-    }
+    SpaceMetrics M;
+
+    M.SetFree(FreeSpace.ExtentCount(), FreeSpace.LargestExtent(), available_space);
+
+    return M;
+  }
+
+  SpaceMetrics Metrics() {
+
+    SpaceMetrics M = FreeMetrics();
+
+    Table.SetFileMetrics(M, block_count - available_space, block_size, ExtentsPerFile());
+
+    return M;
   }
 
   /*
-    Prints the Directory table contents, used for debugging
+    Returns the average number of extents of the files in the directory
   */
-  void ExploreTable() {
+  double ExtentsPerFile() {
 
-    for (auto el : Table.Table) {
-      File F = el.second;
-      cout << el.first << " : " << F.index << " " << F.block_len << " " << F.byte_len << endl;
+    if (Extents.empty()) return 0.0;
+
+    double total = 0.0;
+
+    for (auto& el : Extents) {
+      total += el.second.size();
     }
+
+    return total / Extents.size();
   }
 
   /*
     Returns a slice of directory as a vector
   */
-  vector<int> Slice(int l, int r) {
+  vector<int> Slice(BlockIndex l, BlockIndex r) {
 
     vector<int> Res;
 
-    for (int i = l ; i < r ; ++i)
+    for (BlockIndex i = l ; i < r ; ++i)
       Res.push_back(Directory[i]);
 
     return Res;
@@ -812,118 +3273,243 @@ struct ContiguousAllocation : Allocation {
     return map of Directory Table
   */
   unordered_map<int, File> ViewTable() {
-    return Table.Table;
+    return Table.ToMap();
   }
 
 };
 
 /*
-  This struct type represents a file that is used in linked allocation.
-  Its attributes:
+  This struct type encapsulates a file system implemented using a binary
+  buddy allocator. Free space is kept as runs of 2^k blocks starting at a
+  multiple of 2^k, one free list per order k. A request of n blocks takes
+  a run of the smallest order that fits it, splitting a larger run into
+  halves (buddies) as needed, and a released run is merged with its buddy
+  as long as the buddy is free as well, so taking and releasing a run cost
+  O(log block_count) and no compaction is ever needed. The price is
+  internal fragmentation: blocks of a run that the file does not use are
+  still taken. A file is a list of runs, all of them full except the last,
+  which is filled first when the file is extended. When no single run is
+  large enough, a request is split into exact powers of two. Its
+  Attributes:
 
-  state: can be either empty or full
-  next:   stores the ID of the next
-  ID:     stored the ID of the linked file
+  block_size:       the size of the block
+  available_space:  stores the number of blocks that belong to no run
+  max_order:        order of the largest run, 2^max_order <= block_count
+  Table:            stores Directory Table, the index of a file is the
+                    first block of its first run
+  Directory:        stores for every block the ID of the file owning it,
+                    including unused blocks of its last run
+  FreeOrder:        for the first block of every free run, its order plus
+                    one, zero for any other block
+  Next, Prev:       links of the free lists, kept on the first block of
+                    every free run
+  Heads:            first run of the free list of every order
+  Runs:             the runs of every file sorted by logical block, their
+                    length is the whole run even if it is not full
 */
-struct LinkedFile {
+struct BuddyAllocation final : Allocation {
 
-  int state;
-  int next;
+  int block_size;
+  BlockIndex block_count;
+  BlockIndex available_space;
+  int max_order;
+  DirectoryTable Table;
+  BlockStorage<int> Directory;
+  BlockStorage<unsigned char> FreeOrder;
+  BlockStorage<BlockIndex> Next;
+  BlockStorage<BlockIndex> Prev;
+  vector<BlockIndex> Heads;
+  unordered_map<int, vector<Extent>> Runs;
+  GeneralLogger Logger;
 
-  LinkedFile(): next(END_OF_FILE), state(EMPTY) {}
-  LinkedFile(int _state): next(END_OF_FILE), state(_state) {}
+  BuddyAllocation(int _block_size, BlockIndex _block_count = MAX_BLOCKS) {
+    Table = DirectoryTable();
+    block_size = _block_size;
+    Logger = GeneralLogger("BuddyAllocation");
+    block_count = _block_count;
+    available_space = block_count;
+    max_order = 63 - __builtin_clzll(block_count);
+    Directory = BlockStorage<int>(block_count);
+    FreeOrder = BlockStorage<unsigned char>(block_count);
+    Next = BlockStorage<BlockIndex>(block_count);
+    Prev = BlockStorage<BlockIndex>(block_count);
+    Heads = vector<BlockIndex>(max_order + 1, END_OF_FILE);
+
+    // split the directory into aligned runs, largest first, which is
+    // a single run whenever block_count is a power of two
+    BlockIndex index = 0;
+
+    for (int k = max_order ; 0 <= k ; --k) {
+      if (block_count >> k & 1) {
+        PushFree(index, k);
+        index += 1LL << k;
+      }
+    }
+  }
 
   /*
-    This function changes the state of the File block to occupied
+    Takes length of bytes and returns number of blocks required
+    to store these bytes, which is taken by dividing length by
+    block size and taking the ceil value
   */
-  void Fill(int ID) {
-    state = ID;
+  BlockIndex ByteToBlock(long long length) {
+
+    return (length + block_size - 1) / block_size;
   }
 
   /*
-    This function changes the state of the File block to empty
+    Returns the order of the smallest run holding the given number
+    of blocks
   */
-  void Empty() {
-    state = EMPTY;
-    next = END_OF_FILE;
+  static int OrderOf(BlockIndex length) {
+
+    return length <= 1 ? 0 : 64 - __builtin_clzll(length - 1);
+  }
+
+  void PushFree(BlockIndex index, int order) {
+
+    FreeOrder[index] = order + 1;
+    Prev[index] = END_OF_FILE;
+    Next[index] = Heads[order];
+
+    if (Heads[order] != END_OF_FILE) Prev[Heads[order]] = index;
+
+    Heads[order] = index;
+  }
+
+  void RemoveFree(BlockIndex index, int order) {
+
+    FreeOrder[index] = 0;
+
+    if (Prev[index] != END_OF_FILE) Next[Prev[index]] = Next[index];
+    else Heads[order] = Next[index];
+
+    if (Next[index] != END_OF_FILE) Prev[Next[index]] = Prev[index];
   }
 
   /*
-    This function is used to update the next pointer
+    This function takes a free run of the given order and returns its
+    first block, splitting a larger run if there is no run of that
+    order. It returns FAIL if there is no large enough run.
   */
-  void UpdateNext(int new_next) {
-    next = new_next;
+  BlockIndex TakeRun(int order) {
+
+    int k = order;
+
+    while (k <= max_order && Heads[k] == END_OF_FILE) k++;
+
+    if (max_order < k) return FAIL;
+
+    BlockIndex index = Heads[k];
+    RemoveFree(index, k);
+
+    // keep the lower half and free the upper one until the run
+    // has the requested order
+    while (order < k) {
+      k--;
+      PushFree(index + (1LL << k), k);
+    }
+
+    available_space -= 1LL << order;
+
+    return index;
   }
 
   /*
-    This function is used to update the state to a new given one.
+    This function frees the run of the given order starting at index,
+    merging it with its buddy for as long as the buddy is free
   */
-  void Updatestate(int new_state) {
-    state = new_state;
-  }
+  void ReleaseRun(BlockIndex index, int order) {
 
-};
+    available_space += 1LL << order;
 
-/*
-  This struct type encpsulates a file system implemented using
-  Linked Allocation. Its Attributes:
+    while (order < max_order) {
 
-  block_size:       the size of the block
-  available_space:  stores the number of blocks remaning empty
-  Table:            stores Directory Table
-  Directory:        stores list of Directory where each block is
-                    a LinkedFile instance
-*/
-struct LinkedAllocation : Allocation {
+      BlockIndex buddy = index ^ (1LL << order);
 
-  int block_size;
-  int available_space;
-  DirectoryTable Table;
-  LinkedFile Directory[MAX_BLOCKS];
-  GeneralLogger Logger;
+      if (block_count < buddy + (1LL << order) || FreeOrder[buddy] != order + 1) break;
 
-  LinkedAllocation(int _block_size) {
-    Table = DirectoryTable();
-    block_size = _block_size - POINTER_SIZE;
-    Logger = GeneralLogger("LinkedAllocation");
-    available_space = MAX_BLOCKS;
+      RemoveFree(buddy, order);
+      index = min(index, buddy);
+      order++;
+    }
+
+    PushFree(index, order);
+  }
+
+  void Fill(int fileID, BlockIndex index, BlockIndex length) {
+
+    for (BlockIndex i = index ; i < index + length ; ++i) {
+      Directory[i] = fileID;
+    }
   }
 
   /*
-    Takes length of bytes and returns number of blocks required
-    to store these bytes, which is taken by dividing length by
-    block size and taking the ceil value
+    Releases a whole run of a file
   */
-  int ByteToBlock(int length) {
+  void Release(const Extent& Run) {
 
-    return (length + block_size - 1) / block_size;
+    for (BlockIndex i = Run.physical ; i < Run.physical + Run.length ; ++i) {
+      Directory[i] = EMPTY;
+    }
+
+    ReleaseRun(Run.physical, OrderOf(Run.length));
   }
 
   /*
-    This function attempts to find a space for a file of a
-    given block length, it returns a list of indexes which
-    are available to store the file
+    This function appends runs holding block_num blocks to the given list.
+    A single run is taken if there is one large enough, otherwise the
+    request is split into exact powers of two, largest first. If even
+    those cannot be found, the runs taken are given back and REJECT is
+    returned.
   */
-  vector<int> FindAvailableSpace(int block_num) {
+  int Allocate(int fileID, vector<Extent>& List, BlockIndex logical, BlockIndex block_num) {
 
-    vector<int> Res;
+    if (block_num == 0) return SUCCESS;
+
+    int order = OrderOf(block_num);
+
+    if (order <= max_order) {
+
+      BlockIndex index = TakeRun(order);
+
+      if (index != FAIL) {
+        Fill(fileID, index, 1LL << order);
+        List.push_back(Extent(logical, index, 1LL << order));
+        return SUCCESS;
+      }
+    }
 
-    for (int i = 0 ; i < MAX_BLOCKS ; ++i) {
+    size_t first = List.size();
 
-      if (Directory[i].state == EMPTY) {
-        Res.push_back(i);
+    for (int k = max_order ; 0 <= k ; --k) {
+
+      if (!(block_num >> k & 1)) continue;
+
+      BlockIndex index = TakeRun(k);
+
+      if (index == FAIL) {
+
+        while (first < List.size()) {
+          Release(List.back());
+          List.pop_back();
+        }
+
+        return REJECT;
       }
 
-      if (Res.size() == block_num) return Res;
+      Fill(fileID, index, 1LL << k);
+      List.push_back(Extent(logical, index, 1LL << k));
+      logical += 1LL << k;
     }
 
-    return Res;
+    return SUCCESS;
   }
 
   /*
     This function creates a new file.
   */
-  int CreateFile(int fileID, int file_length) {
+  int CreateFile(int fileID, long long file_length) {
 
     // if such file exists, the operation fails
     if (Table.FileExists(fileID)) {
@@ -931,7 +3517,7 @@ struct LinkedAllocation : Allocation {
       return FAIL;
     }
 
-    int block_num = ByteToBlock(file_length);
+    BlockIndex block_num = ByteToBlock(file_length);
 
     // if no available space, the operation is rejected
     if (block_num > available_space) {
@@ -939,45 +3525,23 @@ struct LinkedAllocation : Allocation {
       return REJECT;
     }
 
-    vector<int> space = FindAvailableSpace(block_num);
+    vector<Extent> List;
 
-    // ensure that we got same number of spaces as required
-    if (space.size() != block_num) {
-      Logger.LogIssue("CreateFile", "Number of Slots found does not match requested number.");
-      return FAIL;
+    if (Allocate(fileID, List, 0, block_num) == REJECT) {
+      Logger.LogInfo("CreateFile", "Creation Rejected because no buddy run is free");
+      return REJECT;
     }
 
-    // iterate over spaces and fill them
-    for (int i = 0 ; i < block_num ; ++i) {
-
-      int x = space[i];
-
-      // ensure that selected spaces are empty
-      if (Directory[x].state != EMPTY) {
-        Logger.LogIssue("CreateFile", "Expected an empty space in directory, but it is not empty");
-        return FAIL;
-      }
-
-      // fill block slot in directory
-      Directory[x].Fill(fileID);
-
-      // if not last block, update its next
-      if (i + 1 < block_num) {
-
-        int next = space[i + 1];
-        Directory[x].UpdateNext(next);
-      }
-    }
+    BlockIndex index = List.empty() ? END_OF_FILE : List[0].physical;
 
     // add file to Directory Table
-    int status = Table.AddFile(fileID, File(space[0], block_num, file_length));
+    int status = Table.AddFile(fileID, File(index, block_num, file_length));
 
     if (status == FAIL) {
       return status;
     }
 
-    // update available space
-    available_space -= block_num;
+    Runs[fileID] = List;
 
     return SUCCESS;
   }
@@ -985,211 +3549,200 @@ struct LinkedAllocation : Allocation {
   /*
     This function takes a file ID and a byte offset of that file, and
     it returns the index of the block at which given offset of the
-    file is stored in the directory
+    file is stored in the directory. The run holding the offset is
+    found with a binary search over the runs of the file
   */
-  int Access(int fileID, int byte_offset) {
+  BlockIndex Access(int fileID, long long byte_offset) {
+
+    File* F = Table.Find(fileID);
 
     // if such file does not exist, operation fails
-    if (!Table.FileExists(fileID)) {
+    if (F == NULL) {
       Logger.LogInfo("Access", "Cannot access file that does not exist");
       return FAIL;
     }
 
-    File F = Table.GetFile(fileID);
-
-    if (F == NullFile) {
+    // if byte offset is larger the file byte length, operation fails
+    if (F->byte_len < byte_offset) {
+      Logger.LogInfo("Access", "Byte offset to be accessed exceeds actual file size");
       return FAIL;
     }
 
-    // if byte offset is larger the file byte length, operation fails
-    if (F.byte_len < byte_offset) {
-      Logger.LogInfo("Access", "Byte offset to be accessed exceeds actual file size");
+    BlockIndex logical = max(ByteToBlock(byte_offset) - 1, 0LL);
+
+    vector<Extent>& List = Runs[fileID];
+
+    if (List.empty()) {
       return FAIL;
     }
 
-    int index = Table.GetFile(fileID).index;
+    // find the last run starting at or before the logical block
+    int lo = 0, hi = List.size() - 1;
 
-    // keep moving from the start until we reach the block
-    // which contains the required byte offset
-    while (block_size < byte_offset) {
-      byte_offset -= block_size;
-      index = Directory[index].next;
+    while (lo < hi) {
+
+      int mid = (lo + hi + 1) / 2;
+
+      if (List[mid].logical <= logical) lo = mid;
+      else hi = mid - 1;
     }
 
-    return index;
+    return List[lo].physical + logical - List[lo].logical;
   }
 
   /*
     This function takes a file and an extension amount, and it
     extends the desired file by the number of blocks equal to
-    the given amount
+    the given amount. Unused blocks of the last run are used
+    first, and new runs are only taken for the remaining blocks
   */
-  int Extend(int fileID, int extension_amount) {
+  int Extend(int fileID, BlockIndex extension_amount) {
+
+    File* F = Table.Find(fileID);
 
     // if such file does not exist, operation fails
-    if (!Table.FileExists(fileID)) {
+    if (F == NULL) {
       Logger.LogIssue("Extend", "Cannot extend file that does not exist");
       return FAIL;
     }
 
+    vector<Extent>& List = Runs[fileID];
+
+    BlockIndex capacity = List.empty() ? 0 : List.back().logical + List.back().length;
+    BlockIndex remaining = max(F->block_len + extension_amount - capacity, 0LL);
+
     // if no available space of extension, reject
-    if (available_space < extension_amount) {
+    if (available_space < remaining) {
       Logger.LogInfo("Extend", "Extension Rejected due to insufficient space");
       return REJECT;
     }
 
-    File F = Table.GetFile(fileID);
-
-    if (F == NullFile) {
-      return FAIL;
+    if (Allocate(fileID, List, capacity, remaining) == REJECT) {
+      Logger.LogInfo("Extend", "Extension Rejected because no buddy run is free");
+      return REJECT;
     }
 
-    // find available indexes
-    vector<int> space = FindAvailableSpace(extension_amount);
+    if (F->index == END_OF_FILE && !List.empty()) F->index = List[0].physical;
 
-    // ensure that space slots found match required
-    if (space.size() != extension_amount) {
-      Logger.LogIssue("Extend", "Number of Slots found does not match requested number.");
-      return FAIL;
-    }
+    // update lengths in Directory table
+    F->block_len += extension_amount;
+    F->byte_len += block_size * extension_amount;
+
+    return SUCCESS;
+  }
 
-    int index = F.index;
+  /*
+    This function shrinks a file by a given amount. Runs that hold no
+    block of the file anymore are released, and the last run gives back
+    its upper halves for as long as they are unused
+  */
+  int Shrink(int fileID, BlockIndex shrink_amount) {
 
-    // go to the last block in order to update its next
-    while (Directory[index].next != END_OF_FILE) {
-      index = Directory[index].next;
+    File* F = Table.Find(fileID);
+
+    // if such file does not exist, operation fails
+    if (F == NULL) {
+      Logger.LogIssue("Shrink", "Cannot shrink file that does not exist");
+      return FAIL;
     }
 
-    // set the next of the last block to its new next which
-    // came to existence after extension
-    Directory[index].next = space[0];
+    // shrink amount cannot exceed current length
+    if (F->block_len <= shrink_amount) {
+      Logger.LogIssue("Shrink", "Shrink aborted because shrink amount is greater than file size");
+      return FAIL;
+    }
 
-    for (int i = 0 ; i < space.size() ; ++i) {
+    BlockIndex blocks_left = F->block_len - shrink_amount;
 
-      int x = space[i];
+    vector<Extent>& List = Runs[fileID];
 
-      // ensure chosen slot is empty
-      if (Directory[x].state != EMPTY) {
-        Logger.LogIssue("CreateFile", "Expected an empty space in directory, but it is not empty");
-        return FAIL;
-      }
+    while (blocks_left <= List.back().logical) {
+      Release(List.back());
+      List.pop_back();
+    }
 
-      Directory[x].Fill(fileID);
+    Extent& Last = List.back();
 
-      // if not last block set its next pointer
-      if (i + 1 < space.size()) {
-        int next = space[i + 1];
-        Directory[x].UpdateNext(next);
-      }
+    while (1 < Last.length && blocks_left - Last.logical <= Last.length / 2) {
+      Last.length /= 2;
+      Release(Extent(Last.logical + Last.length, Last.physical + Last.length, Last.length));
     }
 
     // update lengths in Directory table
-    Table.UpdateBlockLen(fileID, F.block_len + extension_amount);
-    Table.UpdateByteLen(fileID, F.byte_len + block_size * extension_amount);
-
-    // update available space
-    available_space -= extension_amount;
+    F->block_len = blocks_left;
+    F->byte_len -= block_size * shrink_amount;
 
     return SUCCESS;
   }
 
   /*
-    This function shrinks a file by a given amount. If shrink values
-    makes the number of blocks zero, then this file is removed from
-    the directory
+    Returns the average number of extents of the files in the directory,
+    runs that happen to be next to each other count as one extent
   */
-  int Shrink(int fileID, int shrink_amount) {
-
-    // if such file does not exist, operation fails
-    if (!Table.FileExists(fileID)) {
-      Logger.LogIssue("Shrink", "Cannot shrink file that does not exist");
-      return FAIL;
-    }
+  double ExtentsPerFile() {
 
-    File F = Table.GetFile(fileID);
+    if (Runs.empty()) return 0.0;
 
-    if (F == NullFile) {
-      return FAIL;
-    }
+    double total = 0.0;
 
-    // shrink amoutn cannot exceed current length
-    if (F.block_len <= shrink_amount) {
-      Logger.LogIssue("Shrink", "Shrink aborted because shrink amount is greater than file size");
-      return FAIL;
+    for (auto& el : Runs) {
+      for (size_t i = 0 ; i < el.second.size() ; ++i) {
+        if (i == 0 || el.second[i].physical != el.second[i - 1].physical + el.second[i - 1].length) total++;
+      }
     }
 
-    int blocks_left = F.block_len - shrink_amount;
-
-    int index = F.index;
-
-    // if blocks left is equal to zero, then file is removed from
-    // directory
-    if (blocks_left == 0) {
-
-      int status = Table.RemoveFile(fileID);
+    return total / Runs.size();
+  }
 
-      if (status == FAIL) return status;
+  /*
+    Free runs are found on the directory, where blocks of free runs are
+    empty, so that buddies next to each other without being merged still
+    count as a single free extent
+  */
+  SpaceMetrics FreeMetrics() {
 
-    } else {
+    SpaceMetrics M;
+    BlockIndex runs = 0, largest = 0, length = 0;
 
-      // update lengths in Directory table
-      Table.UpdateBlockLen(fileID, F.block_len - shrink_amount);
-      Table.UpdateByteLen(fileID, F.byte_len - block_size * shrink_amount);
+    for (BlockIndex i = 0 ; i < block_count ; ++i) {
 
-      // find the index of the last block that remains after shrinking
-      for (int i = 0 ; i < blocks_left - 1 ; ++i) {
-        index = Directory[index].next;
+      if (Directory[i] != EMPTY) {
+        length = 0;
+        continue;
       }
 
-      // set the next pointer of the last remaining block to end of file
-      int next = Directory[index].next;
-      Directory[index].UpdateNext(END_OF_FILE);
-      index = next;
-    }
+      if (length == 0) runs++;
 
-    // remove all blocks that have been released after shrinking
-    while (index != END_OF_FILE) {
-      int next = Directory[index].next;
-      Directory[index].Empty();
-      index = next;
+      length++;
+      largest = max(largest, length);
     }
 
-    // update available space
-    available_space += shrink_amount;
+    M.SetFree(runs, largest, available_space);
 
-    return SUCCESS;
+    return M;
   }
 
   /*
-    used for debugging
+    Internal fragmentation includes the unused blocks of every last run
   */
-  void PrintSlice(int l, int r) {
+  SpaceMetrics Metrics() {
 
-    for (int i = l ; i < r ; ++i) {
-      cout << Directory[i].state << endl;
-    }
-  }
+    SpaceMetrics M = FreeMetrics();
 
-  /*
-    used for debugging
-  */
-  void ExploreTable() {
+    Table.SetFileMetrics(M, block_count - available_space, block_size, ExtentsPerFile());
 
-    for (auto el : Table.Table) {
-      File F = el.second;
-      cout << el.first << " : " << F.index << " " << F.block_len << " " << F.byte_len << endl;
-    }
+    return M;
   }
 
   /*
     Returns a slice of directory as a vector
   */
-  vector<int> Slice(int l, int r) {
+  vector<int> Slice(BlockIndex l, BlockIndex r) {
 
     vector<int> Res;
 
-    for (int i = l ; i < r ; ++i)
-      Res.push_back(Directory[i].state);
+    for (BlockIndex i = l ; i < r ; ++i)
+      Res.push_back(Directory[i]);
 
     return Res;
   }
@@ -1198,7 +3751,7 @@ struct LinkedAllocation : Allocation {
     return map of Directory Table
   */
   unordered_map<int, File> ViewTable() {
-    return Table.Table;
+    return Table.ToMap();
   }
 
-};
\ No newline at end of file
+};
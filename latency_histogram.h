@@ -0,0 +1,119 @@
+#pragma once
+
+#include <cstring>
+#include <string>
+
+using namespace std;
+
+#define HISTOGRAM_SUB_BITS 5
+#define HISTOGRAM_BUCKETS ((64 - HISTOGRAM_SUB_BITS + 1) << HISTOGRAM_SUB_BITS)
+
+/*
+  This struct type records latencies in a log bucketed histogram, in the
+  style of HDR histograms. Values below 2^HISTOGRAM_SUB_BITS get a bucket
+  each, and every larger power of two range is split into
+  2^HISTOGRAM_SUB_BITS equal buckets, so any value is known within about
+  3% while the histogram has a fixed size and recording is a few shifts.
+  Its attributes:
+
+  Counts:     number of values recorded in every bucket
+  count:      total number of values recorded
+  max_value:  largest value recorded, which is kept exactly
+*/
+struct LatencyHistogram {
+
+  long long Counts[HISTOGRAM_BUCKETS];
+  long long count;
+  long long max_value;
+
+  LatencyHistogram() {
+    memset(Counts, 0, sizeof(Counts));
+    count = 0;
+    max_value = 0;
+  }
+
+  /*
+    Returns the bucket a value falls in
+  */
+  static int BucketOf(unsigned long long value) {
+
+    if (value < (1ULL << HISTOGRAM_SUB_BITS)) return value;
+
+    int shift = 63 - __builtin_clzll(value) - HISTOGRAM_SUB_BITS;
+
+    return ((shift + 1) << HISTOGRAM_SUB_BITS) + (value >> shift) - (1 << HISTOGRAM_SUB_BITS);
+  }
+
+  /*
+    Returns the largest value that falls in the given bucket
+  */
+  static unsigned long long BucketValue(int bucket) {
+
+    if (bucket < (1 << HISTOGRAM_SUB_BITS)) return bucket;
+
+    int shift = (bucket >> HISTOGRAM_SUB_BITS) - 1;
+    unsigned long long first = (unsigned long long) ((bucket & ((1 << HISTOGRAM_SUB_BITS) - 1)) + (1 << HISTOGRAM_SUB_BITS)) << shift;
+
+    return first + (1ULL << shift) - 1;
+  }
+
+  /*
+    Records the given value, the given number of times
+  */
+  void Record(long long value, long long times = 1) {
+
+    if (value < 0) value = 0;
+
+    Counts[BucketOf(value)] += times;
+    count += times;
+
+    if (max_value < value) max_value = value;
+  }
+
+  /*
+    Merges the values recorded in another histogram into this one
+  */
+  void Add(const LatencyHistogram& H) {
+
+    for (int i = 0 ; i < HISTOGRAM_BUCKETS ; ++i) {
+      Counts[i] += H.Counts[i];
+    }
+
+    count += H.count;
+    max_value = max(max_value, H.max_value);
+  }
+
+  /*
+    Returns the value below which the given percent of the recorded
+    values are, rounded up to the end of its bucket
+  */
+  long long Percentile(double percent) {
+
+    if (count == 0) return 0;
+
+    long long target = (long long) (percent / 100.0 * count + 0.5);
+
+    if (target < 1) target = 1;
+
+    long long seen = 0;
+
+    for (int i = 0 ; i < HISTOGRAM_BUCKETS ; ++i) {
+
+      seen += Counts[i];
+
+      if (target <= seen) return min((long long) BucketValue(i), max_value);
+    }
+
+    return max_value;
+  }
+
+  /*
+    Returns the tail percentiles of the histogram as one line of text
+  */
+  string Summary() {
+
+    return "p50 " + to_string(Percentile(50)) + ", p90 " + to_string(Percentile(90))
+      + ", p99 " + to_string(Percentile(99)) + ", p99.9 " + to_string(Percentile(99.9))
+      + ", max " + to_string(max_value);
+  }
+};
@@ -0,0 +1,192 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <stdio.h>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+#define LOG_LEVEL_INFO 1
+#define LOG_LEVEL_ISSUE 2
+#define LOG_LEVEL_OFF 3
+
+// messages below this level are removed at compile time, build with
+// -DLOG_LEVEL=LOG_LEVEL_INFO to see them
+#ifndef LOG_LEVEL
+#define LOG_LEVEL LOG_LEVEL_ISSUE
+#endif
+
+#define LOG_ARGS 4
+#define LOG_QUEUE_SIZE (1 << 14)
+
+/*
+  This struct type is a message waiting to be written. Only pointers to
+  string literals and integers are stored, the text is formatted by the
+  thread that writes it. Its attributes:
+
+  level:      LOG_LEVEL_INFO or LOG_LEVEL_ISSUE
+  class_name: name of the class that logged the message
+  func_name:  name of the function that logged the message
+  format:     printf format of the message, taking up to LOG_ARGS
+              arguments of type long long
+  Args:       the arguments of the format
+*/
+struct LogRecord {
+
+  int level;
+  const char* class_name;
+  const char* func_name;
+  const char* format;
+  long long Args[LOG_ARGS];
+};
+
+/*
+  This struct type is a bounded lock free queue of messages, with any
+  number of threads adding messages and a background thread writing
+  them out, issues to standard output and infos to standard error. A
+  thread adding a message only claims a cell with an atomic operation
+  and copies the record in, so logging costs the same whatever the
+  message. Every cell carries a sequence number telling whether it is
+  ready to be written or to be read, as in Vyukov's bounded queue. When
+  the queue is full, threads adding messages wait for room rather than
+  losing messages. Its attributes:
+
+  Cells:    the ring of cells
+  Sequence: sequence number of every cell
+  head:     position of the next message to be taken out
+  tail:     position of the next cell to be claimed
+  written:  number of messages written out so far
+  stop:     tells the background thread to write what is left and exit
+  Writer:   the background thread
+*/
+struct LogQueue {
+
+  vector<LogRecord> Cells;
+  vector<atomic<size_t>> Sequence;
+  atomic<size_t> head;
+  atomic<size_t> tail;
+  atomic<size_t> written;
+  atomic<bool> stop;
+  thread Writer;
+
+  LogQueue(): Cells(LOG_QUEUE_SIZE), Sequence(LOG_QUEUE_SIZE), head(0), tail(0), written(0), stop(false) {
+
+    for (size_t i = 0 ; i < LOG_QUEUE_SIZE ; ++i) {
+      Sequence[i].store(i, memory_order_relaxed);
+    }
+
+    Writer = thread([this]() { Drain(); });
+  }
+
+  ~LogQueue() {
+
+    stop.store(true);
+    Writer.join();
+  }
+
+  void Push(const LogRecord& R) {
+
+    size_t pos = tail.load(memory_order_relaxed);
+
+    while (true) {
+
+      size_t seq = Sequence[pos & (LOG_QUEUE_SIZE - 1)].load(memory_order_acquire);
+      long long diff = (long long) seq - (long long) pos;
+
+      if (diff == 0) {
+        if (tail.compare_exchange_weak(pos, pos + 1, memory_order_relaxed)) break;
+        continue;
+      }
+
+      // the cell has not been read yet, the queue is full
+      if (diff < 0) this_thread::yield();
+
+      pos = tail.load(memory_order_relaxed);
+    }
+
+    Cells[pos & (LOG_QUEUE_SIZE - 1)] = R;
+    Sequence[pos & (LOG_QUEUE_SIZE - 1)].store(pos + 1, memory_order_release);
+  }
+
+  /*
+    This function takes the next message out of the queue into R, and
+    returns false if there is none ready
+  */
+  bool Pop(LogRecord& R) {
+
+    size_t pos = head.load(memory_order_relaxed);
+
+    if (Sequence[pos & (LOG_QUEUE_SIZE - 1)].load(memory_order_acquire) != pos + 1) return false;
+
+    R = Cells[pos & (LOG_QUEUE_SIZE - 1)];
+    Sequence[pos & (LOG_QUEUE_SIZE - 1)].store(pos + LOG_QUEUE_SIZE, memory_order_release);
+    head.store(pos + 1, memory_order_release);
+
+    return true;
+  }
+
+  void Write(const LogRecord& R) {
+
+    char msg[512];
+    snprintf(msg, sizeof(msg), R.format, R.Args[0], R.Args[1], R.Args[2], R.Args[3]);
+
+    bool issue = R.level == LOG_LEVEL_ISSUE;
+
+    fprintf(issue ? stdout : stderr, "%s: %s: %s: %s\n", issue ? "Issue" : "Info", R.class_name, R.func_name, msg);
+  }
+
+  void Drain() {
+
+    LogRecord R;
+
+    while (true) {
+
+      if (Pop(R)) {
+        Write(R);
+        written.fetch_add(1, memory_order_release);
+        continue;
+      }
+
+      if (stop.load()) break;
+
+      this_thread::sleep_for(chrono::microseconds(100));
+    }
+
+    // messages pushed before stop was set may still be arriving
+    while (head.load() != tail.load()) {
+
+      if (!Pop(R)) continue;
+
+      Write(R);
+      written.fetch_add(1, memory_order_release);
+    }
+  }
+
+  /*
+    Waits until every message added so far has been written out. A
+    message leaves the queue before it is written, so this waits on the
+    count of messages written rather than on head
+  */
+  void Flush() {
+
+    while (written.load(memory_order_acquire) != tail.load(memory_order_acquire)) {
+      this_thread::yield();
+    }
+
+    fflush(stdout);
+    fflush(stderr);
+  }
+};
+
+/*
+  Returns the queue all loggers share, it is created along with its
+  background thread by the first message, and written out at exit
+*/
+LogQueue& GetLogQueue() {
+
+  static LogQueue Queue;
+
+  return Queue;
+}
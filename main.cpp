@@ -1,50 +1,55 @@
 #include "file_data_structures.h"
-#include <sstream>
-#include <fstream>
-#include <chrono>
+#include "trace.h"
+#include "parallel_runner.h"
+#include "latency_histogram.h"
+#include "timing.h"
+#include "workload_generator.h"
+#include "sampler.h"
+#include "concurrent_allocation.h"
+#include "snapshot.h"
 #include <ctime>
 
-#define TimePoint chrono::_V2::system_clock::time_point
-#define TimeNow chrono::system_clock::now
-#define duration chrono::duration
 #define INPUT_N 5
 #define REP 5
-
-/*
-  These structs below are used to modularize the handling of calls
-  when splitting and parsing the files
-*/
-
-struct Call {
-
-  Call() {}
-};
-
-struct CreateCall : Call {
-  int bytes;
-  CreateCall(int _bytes): bytes(_bytes) {}
-};
-
-struct AccessCall : Call {
-  int fileID;
-  int offset;
-
-  AccessCall(int _fileID, int _offset): fileID(_fileID), offset(_offset) {}
-};
-
-struct ExtendCall : Call {
-  int fileID;
-  int extension_amount;
-
-  ExtendCall(int _fileID, int amount): fileID(_fileID), extension_amount(amount) {}
-};
-
-struct ShrinkCall : Call {
-  int fileID;
-  int shrink_amount;
-
-  ShrinkCall(int _fileID, int amount): fileID(_fileID), shrink_amount(amount) {}
-};
+#define BLOCK_COUNT MAX_BLOCKS
+#define JUMP_INTERVAL 16
+#define LINKED_GROUP_SIZE 1024
+#define THREADS 0
+#define PIN_THREADS false
+#define TIMER_CLOCK CLOCK_RDTSC
+#define TIMING_MODE TIMING_EVERY
+#define TIMING_PERIOD 16
+#define SYNTHETIC_OPS 0
+
+// the first attempt of every job is sampled every SAMPLE_EVERY_OPS calls
+// and every SAMPLE_EVERY_US microseconds, zero turns either off
+#define SAMPLE_EVERY_OPS 0
+#define SAMPLE_EVERY_US 0
+#define SAMPLE_CAPACITY 4096
+#define SAMPLE_FORMAT SAMPLE_CSV
+
+// calls of the concurrent replay, split among the threads, and the
+// largest number of threads it scales to, zero means one per core
+#define CONCURRENT_OPS 0
+#define CONCURRENT_THREADS 0
+
+// with SNAPSHOT_PATH set, the first SNAPSHOT_AFTER_OPS calls of every
+// trace are not measured. The state they leave is saved to an image
+// named after SNAPSHOT_PATH, the allocation method and the file, and
+// later runs restore it rather than applying those calls again
+#define SNAPSHOT_PATH ""
+#define SNAPSHOT_AFTER_OPS 1000
+
+#define STRATEGY_N 9
+#define CONTIGUOUS 0
+#define LINKED 1
+#define INDEXED 2
+#define EXTENT 3
+#define BUDDY 4
+#define CONTIGUOUS_NEXT_FIT 5
+#define CONTIGUOUS_BEST_FIT 6
+#define CONTIGUOUS_WORST_FIT 7
+#define LINKED_LOCAL 8
 
 /*
   This type is used to collect the experiment result, and it additionally provides
@@ -61,6 +66,18 @@ struct Results {
   double extend_time = 0.0;
   double shrink_time = 0.0;
   double access_failure = 0.0;
+  double extents_per_file = 0.0;
+  double jump_index_bytes = 0.0;
+
+  // fragmentation and relocation of the directory at the end of the run
+  SpaceMetrics space;
+
+  // latency of every single call in nanoseconds, these are merged
+  // rather than averaged when attempts are combined
+  LatencyHistogram create_hist;
+  LatencyHistogram access_hist;
+  LatencyHistogram extend_hist;
+  LatencyHistogram shrink_hist;
 
   Results(): create_rejects(0.0), extend_rejects(0.0) {}
   Results(int cr, int er, int rt): create_rejects(cr), extend_rejects(er), run_time(rt) {}
@@ -76,6 +93,19 @@ struct Results {
     R.extend_time = extend_time + Res.extend_time;
     R.shrink_time = shrink_time + Res.shrink_time;
     R.access_failure = access_failure + Res.access_failure;
+    R.extents_per_file = extents_per_file + Res.extents_per_file;
+    R.jump_index_bytes = jump_index_bytes + Res.jump_index_bytes;
+    R.space = space;
+    R.space.Add(Res.space);
+
+    R.create_hist = create_hist;
+    R.access_hist = access_hist;
+    R.extend_hist = extend_hist;
+    R.shrink_hist = shrink_hist;
+    R.create_hist.Add(Res.create_hist);
+    R.access_hist.Add(Res.access_hist);
+    R.extend_hist.Add(Res.extend_hist);
+    R.shrink_hist.Add(Res.shrink_hist);
 
     return R;
   }
@@ -90,9 +120,12 @@ struct Results {
     extend_time /= num;
     shrink_time /= num;
     access_failure /= num;
+    extents_per_file /= num;
+    jump_index_bytes /= num;
+    space.Div(num);
   }
 
-  void Add(Results Res) {
+  void Add(const Results& Res) {
 
     create_rejects += Res.create_rejects;
     extend_rejects += Res.extend_rejects;
@@ -102,6 +135,45 @@ struct Results {
     extend_time += Res.extend_time;
     shrink_time += Res.shrink_time;
     access_failure += Res.access_failure;
+    extents_per_file += Res.extents_per_file;
+    jump_index_bytes += Res.jump_index_bytes;
+    space.Add(Res.space);
+
+    create_hist.Add(Res.create_hist);
+    access_hist.Add(Res.access_hist);
+    extend_hist.Add(Res.extend_hist);
+    shrink_hist.Add(Res.shrink_hist);
+  }
+
+  /*
+    Returns the sum of times of calls with the given op code
+  */
+  double& TimeOf(int code) {
+
+    if (code == OP_CREATE) return create_time;
+    if (code == OP_ACCESS) return access_time;
+    if (code == OP_EXTEND) return extend_time;
+
+    return shrink_time;
+  }
+
+  LatencyHistogram& HistogramOf(int code) {
+
+    if (code == OP_CREATE) return create_hist;
+    if (code == OP_ACCESS) return access_hist;
+    if (code == OP_EXTEND) return extend_hist;
+
+    return shrink_hist;
+  }
+
+  /*
+    Charges the given nanoseconds, spent on a number of calls with
+    the given op code, the time is split evenly between the calls
+  */
+  void Charge(int code, long long nanos, long long calls) {
+
+    TimeOf(code) += nanos * 1e-9;
+    HistogramOf(code).Record(nanos / calls, calls);
   }
 
   void Print(string title) {
@@ -116,6 +188,21 @@ struct Results {
     cout << "Avg Extension Time: " << extend_time << " (ms)" << endl;
     cout << "Avg Shrink Time: " << shrink_time << " (ms)" << endl;
     cout << "Avg Access failure: " << access_failure << endl;
+    cout << "Avg Extents per File: " << extents_per_file << endl;
+    cout << "Avg Jump Index Memory: " << jump_index_bytes << " (bytes)" << endl;
+    cout << "Avg Free Extents: " << space.free_extents << endl;
+    cout << "Avg Largest Free Extent: " << space.largest_free_extent << " (blocks)" << endl;
+    cout << "Avg External Fragmentation: " << space.external_fragmentation << endl;
+    cout << "Avg Internal Fragmentation: " << space.internal_fragmentation << " (bytes)" << endl;
+    cout << "Avg Run Length: " << space.average_run_length << " (blocks)" << endl;
+    cout << "Avg Chain Distance: " << space.average_chain_distance << " (blocks)" << endl;
+    cout << "Avg Compactions: " << space.compactions << endl;
+    cout << "Avg Blocks Moved per Compaction: " << (space.compactions == 0 ? 0.0 : space.blocks_moved / space.compactions) << endl;
+    cout << "Avg Shift Moves: " << space.shift_moves << " (blocks)" << endl;
+    cout << "Creation Latency: " << create_hist.Summary() << " (ns)" << endl;
+    cout << "Access Latency: " << access_hist.Summary() << " (ns)" << endl;
+    cout << "Extension Latency: " << extend_hist.Summary() << " (ns)" << endl;
+    cout << "Shrink Latency: " << shrink_hist.Summary() << " (ns)" << endl;
     puts("");
   }
 };
@@ -136,297 +223,558 @@ string InputFiles[] = {
 */
 int BlockSizes[] = {8, 1024, 1024, 1024, 2048};
 
-int ID = 1;
+/*
+  storing the names of allocation methods, used for logging
+  and for printing the results
+*/
+string StrategyNames[] = {
+  "Contiguous", "Linked", "Indexed", "Extent", "Buddy",
+  "Contiguous Next Fit", "Contiguous Best Fit", "Contiguous Worst Fit",
+  "Linked Local"
+};
 
 GeneralLogger Logger = GeneralLogger("Experiment");
 
 /*
-  This is used to generate IDs for files
+  This is used to generate IDs for files, every experiment owns
+  its own generator so that experiments can run in parallel
 */
-int GetID() {
-  return ID++;
-}
+struct IDGenerator {
 
-void ResetID() {
-  ID = 1;
-}
+  int ID;
+
+  IDGenerator(): ID(1) {}
+
+  int GetID() {
+    return ID++;
+  }
+
+  void ResetID() {
+    ID = 1;
+  }
+};
 
 /*
-  utitlity to compute time durations
+  the clock every experiment is timed with, it is calibrated once
+  in main before any experiment runs and only read afterwards
 */
-double GetDuration(TimePoint L, TimePoint R) {
-
-  duration<double> D = R - L;
+Timer Clock;
 
-  return D.count();
-}
+/*
+  storing every input file decoded once, so that all
+  repetitions of all allocation methods replay them from
+  memory instead of reading and parsing the files again
+*/
+OpBuffer Traces[INPUT_N];
 
 /*
-  converse a string to an integer, useful for parsing
+  This function applies a single call to the allocation method,
+  and counts its rejections and failures in Res. It is instantiated
+  for every allocation method, whose calls are then resolved at
+  compile time and can be inlined
 */
-int ToInt(string s) {
+template<typename Strategy>
+void Apply(Strategy& A, const Op& op, IDGenerator& IDs, Results& Res) {
 
-  stringstream str(s);
+  // creation call case
 
-  int x = 0;
-  str >> x;
+  if (op.code == OP_CREATE) {
 
-  return x;
-}
+    int ID = IDs.GetID();
 
-/*
-  Given a string and a delimiter, split the string
-  according to the delimeter, and return the chunks
-  as a vector of strings
-*/
-vector<string> Split(string str, char del) {
+    int status = A.CreateFile(ID, op.arg1);
 
-  vector<string> Res;
+    if (status == REJECT) Res.create_rejects++;
 
-  int n = str.length(), i = 0;
+    if (status == FAIL) {
+      Logger.LogIssue("CreateCall", "Creation Failed: %lld", op.arg1);
+    }
 
-  string s = "";
+    return;
+  }
 
-  while (i < n) {
+  // access call case
 
-    if (str[i] == del) {
-      Res.push_back(s);
-      s = "";
-    } else {
-      s += str[i];
+  if (op.code == OP_ACCESS) {
+
+    BlockIndex index = A.Access(op.arg1 + 1, op.arg2);
+
+    if (index == FAIL) {
+      Logger.LogInfo("AccessCall", "Access Failed: %lld %lld", op.arg1, op.arg2);
+      Res.access_failure++;
     }
-    i++;
+
+    return;
   }
 
-  if (s.length() > 0) Res.push_back(s);
+  // extension case
 
-  return Res;
+  if (op.code == OP_EXTEND) {
+
+    int status = A.Extend(op.arg1 + 1, op.arg2);
+
+    if (status == REJECT) {
+      Res.extend_rejects++;
+    }
+
+    if (status == FAIL) {
+      Logger.LogIssue("Extend", "Extension Failed: %lld %lld", op.arg1, op.arg2);
+    }
+
+    return;
+  }
+
+  // shrink case
+
+  if (op.code == OP_SHRINK) {
+
+    int status = A.Shrink(op.arg1 + 1, op.arg2);
+
+    if (status == FAIL) {
+      Logger.LogIssue("Shrink", "Shrink failed: %lld %lld", op.arg1, op.arg2);
+    }
+
+    return;
+  }
+
+  cerr << "Invalid Line Input\n";
+  assert(false);
 }
 
 /*
-  This function takes a reference to an allocation method
-  and a file name, and it runs the experiment on the given
-  input file. It collects all metrics and returns those as
-  a Results instance
+  This function brings an allocation method to the state it is in
+  after the first SNAPSHOT_AFTER_OPS calls of the source. If the image
+  at path can be restored, those calls are skipped, otherwise they are
+  applied and the state they leave is saved to the image. Allocation
+  methods without snapshots apply them every time
 */
-Results RunExperiment(Allocation& A, string file_name) {
+template<typename Strategy, typename Source>
+void Restore(Strategy& A, Source& Ops, IDGenerator& IDs, string path) {
 
-  ResetID();
+  Op op;
 
+  if (LoadSnapshot(path, A, IDs.ID) == SUCCESS) {
 
-  ifstream inFile;
+    for (long long k = 0 ; k < SNAPSHOT_AFTER_OPS && Ops.Next(op) ; ++k) {}
 
-  inFile.open(file_name);
+    return;
+  }
 
-  if (!inFile) {
-    cerr << "File Open Failed\n";
+  // rejections and failures before the snapshot are not counted
+  Results Skipped;
+
+  for (long long k = 0 ; k < SNAPSHOT_AFTER_OPS && Ops.Next(op) ; ++k) {
+    Apply(A, op, IDs, Skipped);
   }
 
-  // counting occurence of calls to get average
-  int create_count = 0;
-  int access_count = 0;
-  int extend_count = 0;
-  int shrink_count = 0;
+  if (SaveSnapshot(path, A, IDs.ID) == FAIL) {
+    Logger.LogIssue("Restore", "Snapshot could not be saved");
+  }
+}
 
-  string line;
+/*
+  This function takes a reference to an allocation method
+  and a source of calls, either a trace replayed by an OpCursor
+  or a WorkloadGenerator, and it runs the experiment by applying
+  all calls of the source. It collects all metrics and returns
+  those as a Results instance. Calls are timed as chosen by
+  TIMING_MODE, see TimingPolicy. Strategy is the allocation
+  method itself rather than Allocation, so that the replay loop
+  does not go through virtual calls, although any Allocation&
+  can still be passed. If a sampler is given, it samples the
+  state of the allocation method as the calls are applied. If
+  a snapshot image is given, the calls up to the snapshot are
+  not measured, see Restore
+*/
+template<typename Strategy, typename Source>
+Results RunExperiment(Strategy& A, Source& Ops, Sampler* Samp = NULL, string snapshot = "") {
 
-  Results Res;
+  IDGenerator IDs;
+  TimingPolicy Policy(TIMING_MODE, TIMING_PERIOD);
 
-  TimePoint l_total = TimeNow();
+  // counting timed calls of every op code to get averages
+  long long timed[OP_INVALID] = {0, 0, 0, 0};
 
-  while (inFile >> line) {
+  Results Res;
 
-    // parse line
-    vector<string> Args = Split(line, ':');
+  // the batch being timed in batch mode
+  int batch_code = OP_INVALID;
+  long long batch_len = 0;
+  long long batch_start = 0;
 
-    // creation call case
+  auto Charge = [&](int code, long long nanos, long long calls) {
 
-    if (Args[0] == "c") {
+    Res.Charge(code, nanos, calls);
+    timed[code] += calls;
 
-      CreateCall call = CreateCall(ToInt(Args[1]));
+    if (Samp != NULL) Samp->Record(nanos, calls);
+  };
 
-      int ID = GetID();
+  auto CloseBatch = [&]() {
 
-      TimePoint l_time = TimeNow();
+    if (batch_len != 0) Charge(batch_code, Clock.Elapsed(batch_start, Clock.Stop()), batch_len);
 
-      int status = A.CreateFile(ID, call.bytes);
+    batch_len = 0;
+  };
 
-      TimePoint r_time = TimeNow();
+  if (!snapshot.empty()) Restore(A, Ops, IDs, snapshot);
 
-      if (status == REJECT) Res.create_rejects++;
+  long long l_total = Clock.Start();
 
-      if (status == FAIL) {
-        Logger.LogIssue("CreateCall", "Creation Failed: " + Args[1]);
-      }
+  if (Samp != NULL) Samp->Start(Clock);
 
-      Res.create_time += GetDuration(l_time, r_time);
+  Op op;
 
-      create_count++;
+  while (Ops.Next(op)) {
 
-      continue;
-    }
+    if (Policy.mode == TIMING_BATCH) {
 
-    // access call case
+      // a batch ends when it is full or the op code changes
+      if (batch_len == Policy.period || batch_code != op.code) CloseBatch();
 
-    if (Args[0] == "a") {
+      if (batch_len == 0) {
+        batch_code = op.code;
+        batch_start = Clock.Start();
+      }
 
-      vector<string> Args = Split(line, ':');
+      Apply(A, op, IDs, Res);
+      batch_len++;
 
-      AccessCall call = AccessCall(ToInt(Args[1]) + 1, ToInt(Args[2]));
+    } else if (Policy.Sample()) {
 
-      TimePoint l_time = TimeNow();
+      long long l_time = Clock.Start();
 
-      int index = A.Access(call.fileID, call.offset);
+      Apply(A, op, IDs, Res);
 
-      TimePoint r_time = TimeNow();
+      long long r_time = Clock.Stop();
 
-      if (index == FAIL) {
-        Logger.LogInfo("AccessCall", "Access Failed: " + Args[1] + " " + Args[2]);
-        Res.access_failure++;
-      }
+      Charge(op.code, Clock.Elapsed(l_time, r_time), 1);
 
-      Res.access_time += GetDuration(l_time, r_time);
-      access_count++;
+    } else {
+      Apply(A, op, IDs, Res);
+    }
 
-      continue;
+    // the batch being timed is closed first, so that taking
+    // a sample is not charged to the calls of the batch
+    if (Samp != NULL && Samp->Tick(Clock)) {
+      CloseBatch();
+      Samp->Take(A, Clock);
     }
+  }
 
-    // extension case
+  CloseBatch();
 
-    if (Args[0] == "e") {
+  long long r_total = Clock.Stop();
 
-      vector<string> Args = Split(line, ':');
+  // divide by timed calls of each op code to get average
 
-      ExtendCall call = ExtendCall(ToInt(Args[1]) + 1, ToInt(Args[2]));
+  if (timed[OP_CREATE] != 0) Res.create_time /= timed[OP_CREATE];
+  if (timed[OP_ACCESS] != 0) Res.access_time /= timed[OP_ACCESS];
+  if (timed[OP_EXTEND] != 0) Res.extend_time /= timed[OP_EXTEND];
+  if (timed[OP_SHRINK] != 0) Res.shrink_time /= timed[OP_SHRINK];
 
-      TimePoint l_time = TimeNow();
+  Res.run_time = Clock.Elapsed(l_total, r_total) * 1e-9;
 
-      int status = A.Extend(call.fileID, call.extension_amount);
+  // measured after the timed region since it walks every file
+  Res.extents_per_file = A.ExtentsPerFile();
+  Res.jump_index_bytes = A.JumpIndexBytes();
+  Res.space = A.Metrics();
 
-      TimePoint r_time = TimeNow();
+  return Res;
+}
 
-      if (status == REJECT) {
-        Res.extend_rejects++;
-      }
+/*
+  This struct type is the view one thread of the concurrent replay has of
+  a shared ConcurrentAllocation. Every thread numbers its files from one,
+  and file k of thread t out of threads is file (k - 1) * threads + t + 1
+  of the shared allocation, so threads never touch each other's files
+  while IDs stay dense. Its attributes:
+
+  A:        the shared allocation method
+  thread:   the index of the thread
+  threads:  the number of threads
+*/
+struct ConcurrentClient {
 
-      if (status == FAIL) {
-        Logger.LogIssue("Extend", "Extension Failed: " + Args[1] + " " + Args[2]);
-      }
+  ConcurrentAllocation& A;
+  int thread;
+  int threads;
 
-      Res.extend_time += GetDuration(l_time, r_time);
+  ConcurrentClient(ConcurrentAllocation& A, int thread, int threads): A(A), thread(thread), threads(threads) {}
 
-      extend_count++;
+  int Global(int fileID) {
+    return (fileID - 1) * threads + thread + 1;
+  }
 
-      continue;
-    }
+  int CreateFile(int fileID, long long file_length) {
+    return A.CreateFile(Global(fileID), file_length);
+  }
 
-    // shrink case
+  BlockIndex Access(int fileID, long long byte_offset) {
+    return A.Access(Global(fileID), byte_offset);
+  }
 
-    if (Args[0] == "sh") {
+  int Extend(int fileID, BlockIndex extension_amount) {
+    return A.Extend(Global(fileID), extension_amount);
+  }
 
-      vector<string> Args = Split(line, ':');
+  int Shrink(int fileID, BlockIndex shrink_amount) {
+    return A.Shrink(Global(fileID), shrink_amount);
+  }
+};
 
-      ShrinkCall call = ShrinkCall(ToInt(Args[1]) + 1, ToInt(Args[2]));
+/*
+  This function replays a synthetic workload on a ConcurrentAllocation
+  shared by the given number of threads, each thread generating its own
+  calls on its own files with its own seed. The calls, files and block
+  budget of the workload are split evenly among the threads, so every
+  run does the same work. Threads wait for each other before the first
+  call, and the returned run time is the wall time from the first call
+  of any thread to the last call of all threads
+*/
+Results RunConcurrent(const WorkloadConfig& Workload, int threads) {
 
-      TimePoint l_time = TimeNow();
+  ConcurrentAllocation A(Workload.block_size, BLOCK_COUNT);
 
-      int status = A.Shrink(call.fileID, call.shrink_amount);
+  vector<Results> ThreadRes(threads);
+  vector<long long> Starts(threads), Stops(threads);
+  atomic<int> ready(0);
 
-      TimePoint r_time = TimeNow();
+  RunParallel(threads, threads, PIN_THREADS, [&](size_t t) {
 
-      if (status == FAIL) {
-        Logger.LogIssue("Shrink", "Shrink failed: " + Args[1] + " " + Args[2]);
-      }
+    WorkloadConfig Config = Workload;
+    Config.op_count = Workload.op_count / threads;
+    Config.file_count = max(Workload.file_count / threads, 1);
+    Config.max_blocks = Workload.max_blocks / threads;
+    Config.seed = Workload.seed + t;
 
-      Res.shrink_time += GetDuration(l_time, r_time);
+    WorkloadGenerator Ops(Config);
+    ConcurrentClient Client(A, t, threads);
+    IDGenerator IDs;
 
-      shrink_count++;
+    ready++;
 
-      continue;
-    }
+    while (ready.load() < threads) this_thread::yield();
 
-    cerr << "Invalid Line Input\n";
-    assert(false);
-  }
+    Starts[t] = Clock.Start();
 
-  TimePoint r_total = TimeNow();
+    Op op;
 
-  // divide by occurence of each call to get average
+    while (Ops.Next(op)) {
+      Apply(Client, op, IDs, ThreadRes[t]);
+    }
+
+    Stops[t] = Clock.Stop();
+  });
+
+  Results Res;
 
-  if (create_count != 0) Res.create_time /= create_count;
-  if (access_count != 0) Res.access_time /= access_count;
-  if (extend_count != 0) Res.extend_time /= extend_count;
-  if (shrink_count != 0) Res.shrink_time /= shrink_count;
+  for (int t = 0 ; t < threads ; ++t) {
+    Res.create_rejects += ThreadRes[t].create_rejects;
+    Res.extend_rejects += ThreadRes[t].extend_rejects;
+    Res.access_failure += ThreadRes[t].access_failure;
+  }
 
-  Res.run_time = GetDuration(l_total, r_total);
+  Res.run_time = Clock.Elapsed(*min_element(Starts.begin(), Starts.end()), *max_element(Stops.begin(), Stops.end())) * 1e-9;
+  Res.extents_per_file = A.ExtentsPerFile();
+  Res.space = A.Metrics();
 
   return Res;
 }
 
 void Log(string s) {
 
-  cout << s << endl;
+  cout << s + "\n" << flush;
 }
 
+/*
+  This function builds a fresh instance of the given allocation
+  method for the given block size, and runs the experiment of
+  the given source of calls on it, starting from the given
+  snapshot image if any
+*/
+template<typename Source>
+Results RunStrategy(int strategy, int block_size, Source& Ops, Sampler* Samp = NULL, string snapshot = "") {
+
+  if (strategy == CONTIGUOUS) {
+    ContiguousAllocation CA(block_size, BLOCK_COUNT);
+    return RunExperiment(CA, Ops, Samp, snapshot);
+  }
+
+  if (strategy == LINKED) {
+    LinkedAllocation LA(block_size, BLOCK_COUNT, JUMP_INTERVAL);
+    return RunExperiment(LA, Ops, Samp, snapshot);
+  }
+
+  if (strategy == LINKED_LOCAL) {
+    LinkedAllocation LA(block_size, BLOCK_COUNT, JUMP_INTERVAL, LINKED_GROUP_SIZE);
+    return RunExperiment(LA, Ops, Samp, snapshot);
+  }
+
+  if (strategy == INDEXED) {
+    IndexedAllocation IA(block_size, BLOCK_COUNT);
+    return RunExperiment(IA, Ops, Samp, snapshot);
+  }
+
+  if (strategy == CONTIGUOUS_NEXT_FIT) {
+    ContiguousAllocationT<NextFit> CA(block_size, BLOCK_COUNT);
+    return RunExperiment(CA, Ops, Samp, snapshot);
+  }
+
+  if (strategy == CONTIGUOUS_BEST_FIT) {
+    ContiguousAllocationT<BestFit> CA(block_size, BLOCK_COUNT);
+    return RunExperiment(CA, Ops, Samp, snapshot);
+  }
+
+  if (strategy == CONTIGUOUS_WORST_FIT) {
+    ContiguousAllocationT<WorstFit> CA(block_size, BLOCK_COUNT);
+    return RunExperiment(CA, Ops, Samp, snapshot);
+  }
+
+  if (strategy == EXTENT) {
+    ExtentAllocation EA(block_size, BLOCK_COUNT);
+    return RunExperiment(EA, Ops, Samp, snapshot);
+  }
+
+  BuddyAllocation BA(block_size, BLOCK_COUNT);
+  return RunExperiment(BA, Ops, Samp, snapshot);
+}
 
 int main() {
 
   puts("It Has Begun");
 
-  // this will be used to store outputs of all files
-
-  Results ContigRes[INPUT_N];
-  Results LinkedRes[INPUT_N];
+  Clock = Timer(TIMER_CLOCK);
 
-  // run contiguous allocation 
+  // decode all input files once
 
   for (int i = 0 ; i < INPUT_N ; ++i) {
 
-    string file_path = InputFiles[i];
-    int block_size = BlockSizes[i];
+    if (Traces[i].Load(InputFiles[i]) == FAIL) {
+      cerr << "File Open Failed\n";
+    }
+  }
+
+  // every (allocation method, file, attempt) combination is an
+  // independent job, each job writes to its own slot
+
+  vector<Results> JobRes(STRATEGY_N * INPUT_N * REP);
+
+  RunParallel(JobRes.size(), THREADS, PIN_THREADS, [&](size_t job) {
+
+    int s = job / (INPUT_N * REP);
+    int i = job / REP % INPUT_N;
+    int j = job % REP;
 
-    for (int j = 0 ; j < REP ; ++j) {
+    Log(StrategyNames[s] + ": File " + to_string(i) + " Attempt " + to_string(j));
 
-      Log("Contig: File " + to_string(i) + " Attempt " + to_string(j));
+    OpCursor Ops(Traces[i]);
 
-      ContiguousAllocation CA(block_size);
+    string name = StrategyNames[s];
+    replace(name.begin(), name.end(), ' ', '_');
 
-      Results Res = RunExperiment(CA, file_path);
+    // every allocation method and file has an image of its own
+    string snapshot = SNAPSHOT_PATH;
 
-      ContigRes[i].Add(Res);
+    if (!snapshot.empty()) {
+      snapshot += "_" + name + "_" + to_string(i) + "_" + to_string(SNAPSHOT_AFTER_OPS) + ".img";
     }
 
-    ContigRes[i].Div(REP);
+    if (j != 0 || (SAMPLE_EVERY_OPS == 0 && SAMPLE_EVERY_US == 0)) {
+      JobRes[job] = RunStrategy(s, BlockSizes[i], Ops, NULL, snapshot);
+      return;
+    }
+
+    Sampler Samp(SAMPLE_EVERY_OPS, SAMPLE_EVERY_US, SAMPLE_CAPACITY);
+
+    JobRes[job] = RunStrategy(s, BlockSizes[i], Ops, &Samp, snapshot);
+
+    string path = "samples_" + name + "_" + to_string(i) + (SAMPLE_FORMAT == SAMPLE_CSV ? ".csv" : ".jsonl");
+
+    if (Samp.Export(path, SAMPLE_FORMAT) == FAIL) {
+      cerr << "Sample Export Failed\n";
+    }
+  });
+
+  // merge the attempts in job order so that the results do not
+  // depend on the order in which jobs have finished
+
+  Results Res[STRATEGY_N][INPUT_N];
+
+  for (size_t job = 0 ; job < JobRes.size() ; ++job) {
+    Res[job / (INPUT_N * REP)][job / REP % INPUT_N].Add(JobRes[job]);
   }
 
-  // run linked allocation
+  for (int s = 0 ; s < STRATEGY_N ; ++s) {
+    for (int i = 0 ; i < INPUT_N ; ++i) {
+      Res[s][i].Div(REP);
+    }
+  }
+
+  // print results once every pending log message is written out,
+  // so that messages do not interleave with the results
+
+  GetLogQueue().Flush();
 
   for (int i = 0 ; i < INPUT_N ; ++i) {
 
-    string file_path = InputFiles[i];
-    int block_size = BlockSizes[i];
+    for (int s = 0 ; s < STRATEGY_N ; ++s) {
+      Res[s][i].Print(StrategyNames[s] + " Results for file " + to_string(i));
+    }
+  }
+
+  // run every allocation method on the same synthetic workload,
+  // generated while it is replayed
 
-    for (int j = 0 ; j < REP ; ++j) {
+  if (SYNTHETIC_OPS != 0) {
 
-      Log("Linked: File " + to_string(i) + " Attempt " + to_string(j));
+    WorkloadConfig Workload;
+    Workload.op_count = SYNTHETIC_OPS;
 
-      LinkedAllocation LA(block_size);
+    vector<Results> SyntheticRes(STRATEGY_N);
 
-      Results Res = RunExperiment(LA, file_path);
+    RunParallel(STRATEGY_N, THREADS, PIN_THREADS, [&](size_t s) {
 
-      LinkedRes[i].Add(Res);
-    }
+      Log(StrategyNames[s] + ": Synthetic Workload");
+
+      WorkloadGenerator Ops(Workload);
+
+      SyntheticRes[s] = RunStrategy(s, Workload.block_size, Ops);
+    });
+
+    GetLogQueue().Flush();
 
-    LinkedRes[i].Div(REP);
+    for (int s = 0 ; s < STRATEGY_N ; ++s) {
+      SyntheticRes[s].Print(StrategyNames[s] + " Results for synthetic workload");
+    }
   }
 
-  // print results
+  // replay a synthetic workload on a shared concurrent allocation with
+  // a growing number of threads, doubling up to CONCURRENT_THREADS
 
-  for (int i = 0 ; i < INPUT_N ; ++i) {
+  if (CONCURRENT_OPS != 0) {
+
+    WorkloadConfig Workload;
+    Workload.op_count = CONCURRENT_OPS;
+
+    int max_threads = CONCURRENT_THREADS == 0 ? DefaultThreadCount() : CONCURRENT_THREADS;
+    double base = 0.0;
+
+    for (int threads = 1 ; threads <= max_threads ; threads = threads < max_threads && max_threads < 2 * threads ? max_threads : 2 * threads) {
 
-    ContigRes[i].Print("Contiguous Results for file " + to_string(i));
+      Results Res = RunConcurrent(Workload, threads);
 
-    LinkedRes[i].Print("Linked Results for file " + to_string(i));
+      GetLogQueue().Flush();
+
+      // every thread makes an equal share of the calls
+      double throughput = Workload.op_count / threads * threads / Res.run_time;
+
+      if (threads == 1) base = throughput;
+
+      Res.Print("Concurrent Results for " + to_string(threads) + " threads");
+
+      cout << "Throughput: " << throughput << " (calls/s), Speedup: " << throughput / base << endl << endl;
+    }
   }
 
 }
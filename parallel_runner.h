@@ -0,0 +1,72 @@
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <pthread.h>
+#include <sched.h>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+/*
+  Returns the number of threads to use when none is requested, which is
+  the number of cores available to the process
+*/
+int DefaultThreadCount() {
+
+  int n = thread::hardware_concurrency();
+
+  return n == 0 ? 1 : n;
+}
+
+/*
+  This function pins the calling thread to the given core, cores are
+  counted modulo the number of cores of the machine
+*/
+void PinThread(int core) {
+
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(core % DefaultThreadCount(), &set);
+
+  pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+}
+
+/*
+  This function runs Job(0), Job(1), ..., Job(job_count - 1) on a pool of
+  threads and returns once all of them are done. Jobs are handed out one
+  at a time from a shared counter, so a thread that finishes early keeps
+  taking the remaining jobs. Jobs must be independent of each other, and
+  each one should write its output to its own slot so that results can be
+  merged in job order afterwards, whatever order the jobs ran in.
+
+  thread_count: number of threads, zero means one per core
+  pin:          whether thread t is pinned to core t
+*/
+void RunParallel(size_t job_count, int thread_count, bool pin, function<void(size_t)> Job) {
+
+  if (thread_count <= 0) thread_count = DefaultThreadCount();
+
+  atomic<size_t> next(0);
+
+  auto Worker = [&](int t) {
+
+    if (pin) PinThread(t);
+
+    for (size_t i = next++ ; i < job_count ; i = next++) {
+      Job(i);
+    }
+  };
+
+  vector<thread> Threads;
+
+  for (int t = 1 ; t < thread_count ; ++t) {
+    Threads.push_back(thread(Worker, t));
+  }
+
+  // the calling thread takes part as thread 0
+  Worker(0);
+
+  for (thread& T : Threads) T.join();
+}
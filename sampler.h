@@ -0,0 +1,148 @@
+#pragma once
+
+#include "file_data_structures.h"
+#include "timing.h"
+
+#define SAMPLE_CSV 0
+#define SAMPLE_JSONL 1
+
+// the clock is only read every this many calls when sampling by time
+#define SAMPLE_CLOCK_STRIDE 64
+
+/*
+  This struct type is the state of an experiment at one point in time.
+  Its attributes:
+
+  op:           number of calls applied so far
+  time_us:      microseconds since the experiment started
+  space:        free space gauges and counters, see FreeMetrics
+  window_ops:   number of calls timed since the previous sample
+  mean_ns:      mean latency of those calls
+  max_ns:       largest latency of those calls
+*/
+struct Sample {
+
+  long long op;
+  double time_us;
+  SpaceMetrics space;
+  long long window_ops;
+  double mean_ns;
+  long long max_ns;
+};
+
+/*
+  This struct type samples the state of an experiment every period_ops
+  calls, every period_us microseconds, or both. Samples are written to a
+  ring allocated up front, so taking one does not allocate or lock, and
+  once the ring is full the oldest samples are overwritten. Latencies of
+  timed calls are added up between samples, so that every sample holds
+  the latency of the calls since the previous one. Its attributes:
+
+  period_ops:   calls between samples, zero to not sample by calls
+  period_us:    microseconds between samples, zero to not sample by time
+  Ring:         the samples, Ring[count % Ring.size()] is written next
+  count:        number of samples taken so far
+  ops:          number of calls seen so far
+  start:        clock reading when the experiment started
+  last:         clock reading of the previous sample
+  window_*:     latencies of the calls timed since the previous sample
+*/
+struct Sampler {
+
+  long long period_ops;
+  long long period_us;
+  vector<Sample> Ring;
+  long long count;
+  long long ops;
+  long long start;
+  long long last;
+  long long window_ops;
+  long long window_ns;
+  long long window_max;
+
+  Sampler(long long period_ops, long long period_us, size_t capacity):
+    period_ops(period_ops), period_us(period_us), Ring(max(capacity, (size_t) 1)),
+    count(0), ops(0), start(0), last(0), window_ops(0), window_ns(0), window_max(0) {}
+
+  void Start(const Timer& Clock) {
+    start = last = Clock.Stop();
+  }
+
+  /*
+    Adds the latency of calls timed together to the current window
+  */
+  void Record(long long nanos, long long calls) {
+
+    window_ops += calls;
+    window_ns += nanos;
+    window_max = max(window_max, nanos / calls);
+  }
+
+  /*
+    This function is called after every call of the experiment, and
+    returns whether a sample is due
+  */
+  bool Tick(const Timer& Clock) {
+
+    ops++;
+
+    if (period_ops != 0 && ops % period_ops == 0) return true;
+
+    return period_us != 0 && ops % SAMPLE_CLOCK_STRIDE == 0 && period_us * 1000 <= Clock.Elapsed(last, Clock.Stop());
+  }
+
+  template<typename Strategy>
+  void Take(Strategy& A, const Timer& Clock) {
+
+    long long now = Clock.Stop();
+    Sample& S = Ring[count % Ring.size()];
+
+    S.op = ops;
+    S.time_us = Clock.Elapsed(start, now) / 1000.0;
+    S.space = A.FreeMetrics();
+    S.window_ops = window_ops;
+    S.mean_ns = window_ops == 0 ? 0.0 : (double) window_ns / window_ops;
+    S.max_ns = window_max;
+
+    count++;
+    last = now;
+    window_ops = window_ns = window_max = 0;
+  }
+
+  /*
+    This function writes the samples still in the ring, oldest first, to
+    the file at the given path as CSV with a header line, or as JSON Lines
+    with one object per sample. It returns FAIL if the file cannot be
+    written.
+  */
+  int Export(string path, int format) {
+
+    FILE* out = fopen(path.c_str(), "w");
+
+    if (out == NULL) return FAIL;
+
+    if (format == SAMPLE_CSV) {
+      fprintf(out, "op,time_us,free_blocks,free_extents,largest_free_extent,external_fragmentation,"
+        "compactions,blocks_moved,shift_moves,window_ops,mean_ns,max_ns\n");
+    }
+
+    long long first = max(count - (long long) Ring.size(), 0LL);
+
+    for (long long i = first ; i < count ; ++i) {
+
+      Sample& S = Ring[i % Ring.size()];
+
+      const char* line = format == SAMPLE_CSV
+        ? "%lld,%.3f,%.0f,%.0f,%.0f,%.6f,%.0f,%.0f,%.0f,%lld,%.1f,%lld\n"
+        : "{\"op\":%lld,\"time_us\":%.3f,\"free_blocks\":%.0f,\"free_extents\":%.0f,"
+          "\"largest_free_extent\":%.0f,\"external_fragmentation\":%.6f,\"compactions\":%.0f,"
+          "\"blocks_moved\":%.0f,\"shift_moves\":%.0f,\"window_ops\":%lld,\"mean_ns\":%.1f,\"max_ns\":%lld}\n";
+
+      fprintf(out, line, S.op, S.time_us, S.space.free_blocks, S.space.free_extents,
+        S.space.largest_free_extent, S.space.external_fragmentation, S.space.compactions,
+        S.space.blocks_moved, S.space.shift_moves, S.window_ops, S.mean_ns, S.max_ns);
+    }
+
+    return fclose(out) == 0 ? SUCCESS : FAIL;
+  }
+};
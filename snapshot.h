@@ -0,0 +1,515 @@
+#pragma once
+
+#include "file_data_structures.h"
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define SNAPSHOT_MAGIC "FSSNAP"
+#define SNAPSHOT_VERSION 2
+
+#define SNAPSHOT_CONTIGUOUS 0
+#define SNAPSHOT_LINKED 1
+
+// regions start at multiples of this, which is a multiple of the page
+// size of every common machine, so any region can be mapped on its own
+#define SNAPSHOT_ALIGN (1 << 16)
+
+#define REGION_DIRECTORY 0
+#define REGION_FREE_WORDS 1
+#define REGION_FREE_NODES 2
+#define REGION_DENSE 3
+#define REGION_SPARSE 4
+#define SNAPSHOT_REGIONS 5
+
+/*
+  This struct type locates an array in a snapshot image. Its attributes:
+
+  offset: position of the array in the file, a multiple of SNAPSHOT_ALIGN
+  count:  number of elements of the array
+*/
+struct SnapshotRegion {
+
+  long long offset;
+  long long count;
+};
+
+/*
+  This struct type is the header of a snapshot image, the saved state of
+  an allocation method. An image is the header followed by the arrays of
+  the state, each in a region of its own, stored in the byte order and
+  layout of the machine that wrote them, so that they can be mapped back
+  as they are. Its attributes:
+
+  magic:            SNAPSHOT_MAGIC, used to tell images from other files
+  version:          SNAPSHOT_VERSION at the time the file was written
+  strategy:         SNAPSHOT_CONTIGUOUS or SNAPSHOT_LINKED
+  block_size:       the block size the allocation method was built with
+  block_count:      number of blocks of the directory
+  available_space:  number of free blocks
+  next_id:          the next ID the IDGenerator of the experiment hands out
+  file_count:       number of files of the directory table
+  word_count:       number of words of the free bitmap
+  compactions:      counters of contiguous allocation
+  blocks_moved:
+  shift_moves:
+  jump_interval:    settings of linked allocation
+  group_size:
+  Regions:          where every array of the state is, indexed by the
+                    REGION_ codes
+*/
+struct SnapshotHeader {
+
+  char magic[8];
+  int version;
+  int strategy;
+  int block_size;
+  long long block_count;
+  long long available_space;
+  long long next_id;
+  long long file_count;
+  long long word_count;
+  long long compactions;
+  long long blocks_moved;
+  long long shift_moves;
+  long long jump_interval;
+  long long group_size;
+  SnapshotRegion Regions[SNAPSHOT_REGIONS];
+};
+
+/*
+  This struct type writes a snapshot image. Regions are written one after
+  the other at aligned offsets, and the header is written last once all
+  of them are known. The image is written to a temporary file of its own
+  that is renamed to the path when complete, so several writers of the
+  same path never mix their regions and a reader never sees half an
+  image. Its attributes:
+
+  path:   where the image goes
+  temp:   the temporary file being written
+  out:    the file being written
+  end:    the offset right after the last region written
+  Header: the header of the image
+*/
+struct SnapshotWriter {
+
+  string path;
+  string temp;
+  FILE* out;
+  long long end;
+  SnapshotHeader Header;
+
+  SnapshotWriter(string _path, int strategy) {
+
+    path = _path;
+    temp = path + ".XXXXXX";
+
+    int fd = mkstemp(&temp[0]);
+
+    out = fd < 0 ? NULL : fdopen(fd, "wb");
+    end = sizeof(SnapshotHeader);
+
+    if (out == NULL && 0 <= fd) close(fd);
+
+    memset(&Header, 0, sizeof(Header));
+    memcpy(Header.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+    Header.version = SNAPSHOT_VERSION;
+    Header.strategy = strategy;
+  }
+
+  /*
+    Writes count elements of size bytes each as the given region
+  */
+  void Add(int region, const void* data, long long count, size_t size) {
+
+    if (out == NULL) return;
+
+    long long offset = (end + SNAPSHOT_ALIGN - 1) / SNAPSHOT_ALIGN * SNAPSHOT_ALIGN;
+
+    Header.Regions[region].offset = offset;
+    Header.Regions[region].count = count;
+
+    // an empty region may have no data at all
+    if (fseek(out, offset, SEEK_SET) != 0 || (count != 0 && (long long) fwrite(data, size, count, out) != count)) {
+      fclose(out);
+      out = NULL;
+      return;
+    }
+
+    end = offset + count * size;
+  }
+
+  /*
+    Writes the header and puts the image in place, and returns FAIL if
+    anything could not be written, removing the temporary file
+  */
+  int Close() {
+
+    bool written = out != NULL && fseek(out, 0, SEEK_SET) == 0 && fwrite(&Header, sizeof(Header), 1, out) == 1;
+
+    if (out != NULL && fclose(out) != 0) written = false;
+
+    if (written && rename(temp.c_str(), path.c_str()) == 0) return SUCCESS;
+
+    remove(temp.c_str());
+
+    return FAIL;
+  }
+};
+
+/*
+  This struct type opens a snapshot image to restore it. Regions holding
+  arrays of blocks are mapped in place of the arrays of the allocation
+  method, so restoring does not read or parse them. The file can be
+  closed once they are mapped. Every region is checked against the size
+  of the file before it is used, so a truncated image or one with regions
+  out of place fails to open rather than faulting when a page past its
+  end is touched. What the regions hold is only checked where the loader
+  follows it. Its attributes:
+
+  fd:     the file of the image
+  size:   the size of the file in bytes
+  Header: the header of the image
+*/
+struct SnapshotImage {
+
+  int fd;
+  long long size;
+  SnapshotHeader Header;
+
+  SnapshotImage(): fd(-1), size(0) {}
+
+  SnapshotImage(const SnapshotImage&) = delete;
+  SnapshotImage& operator=(const SnapshotImage&) = delete;
+
+  ~SnapshotImage() {
+    if (fd >= 0) close(fd);
+  }
+
+  /*
+    This function opens the image at the given path, and returns FAIL if
+    it cannot be read or is not an image of the given strategy written by
+    this version
+  */
+  int Open(string path, int strategy) {
+
+    fd = open(path.c_str(), O_RDONLY);
+
+    if (fd < 0) return FAIL;
+
+    struct stat st;
+
+    if (fstat(fd, &st) != 0) return FAIL;
+
+    size = st.st_size;
+
+    if (pread(fd, &Header, sizeof(Header), 0) != sizeof(Header)) return FAIL;
+
+    if (memcmp(Header.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) != 0) return FAIL;
+
+    if (Header.version != SNAPSHOT_VERSION || Header.strategy != strategy) return FAIL;
+
+    // the free bitmap has to cover every block of the directory
+    if (Header.block_count <= 0 || Header.word_count < (Header.block_count + 63) / 64) return FAIL;
+
+    if (Header.available_space < 0 || Header.block_count < Header.available_space) return FAIL;
+
+    return SUCCESS;
+  }
+
+  /*
+    Returns whether the given region starts at an aligned offset and its
+    elements of size bytes each all lie within the file
+  */
+  bool Fits(int region, size_t bytes) {
+
+    SnapshotRegion& R = Header.Regions[region];
+
+    if (R.offset < 0 || R.offset % SNAPSHOT_ALIGN != 0 || R.count < 0) return false;
+
+    // an empty region may start past the end of the file
+    return R.count == 0 || (R.offset <= size && R.count <= (size - R.offset) / (long long) bytes);
+  }
+
+  /*
+    Maps the given region, which has to hold count elements, in place of
+    the array S
+  */
+  template<typename T>
+  int Map(int region, BlockStorage<T>& S, long long count) {
+
+    SnapshotRegion& R = Header.Regions[region];
+
+    if (R.count != count || !Fits(region, sizeof(T))) return FAIL;
+
+    S = BlockStorage<T>(fd, R.offset, R.count);
+
+    return S.Data == NULL ? FAIL : SUCCESS;
+  }
+
+  /*
+    Reads the given region into a vector, in a single read
+  */
+  template<typename T>
+  int Read(int region, vector<T>& V) {
+
+    SnapshotRegion& R = Header.Regions[region];
+
+    if (!Fits(region, sizeof(T))) return FAIL;
+
+    long long bytes = R.count * sizeof(T);
+
+    V.resize(R.count);
+
+    return pread(fd, V.data(), bytes, R.offset) == bytes ? SUCCESS : FAIL;
+  }
+};
+
+/*
+  Writes the directory table, the dense part as a single region and the
+  files with sparse IDs as (ID, File) pairs
+*/
+void SaveTable(SnapshotWriter& Out, DirectoryTable& Table) {
+
+  vector<pair<int, File>> Sparse(Table.Sparse.begin(), Table.Sparse.end());
+
+  Out.Header.file_count = Table.file_count;
+  Out.Add(REGION_DENSE, Table.Dense.data(), Table.Dense.size(), sizeof(DirectoryTable::Slot));
+  Out.Add(REGION_SPARSE, Sparse.data(), Sparse.size(), sizeof(pair<int, File>));
+}
+
+int LoadTable(SnapshotImage& Image, DirectoryTable& Table) {
+
+  vector<pair<int, File>> Sparse;
+
+  if (Image.Read(REGION_DENSE, Table.Dense) == FAIL) return FAIL;
+  if (Image.Read(REGION_SPARSE, Sparse) == FAIL) return FAIL;
+
+  Table.Sparse = unordered_map<int, File>(Sparse.begin(), Sparse.end());
+  Table.file_count = Image.Header.file_count;
+
+  return SUCCESS;
+}
+
+/*
+  This function writes the state of a contiguous allocation method, along
+  with the next ID of the experiment, to an image at the given path. It
+  returns FAIL if the image cannot be written
+*/
+template<typename Placement>
+int SaveSnapshot(string path, ContiguousAllocationT<Placement>& A, int next_id) {
+
+  SnapshotWriter Out(path, SNAPSHOT_CONTIGUOUS);
+
+  Out.Header.block_size = A.block_size;
+  Out.Header.block_count = A.block_count;
+  Out.Header.available_space = A.available_space;
+  Out.Header.next_id = next_id;
+  Out.Header.word_count = A.FreeSpace.word_count;
+  Out.Header.compactions = A.compactions;
+  Out.Header.blocks_moved = A.blocks_moved;
+  Out.Header.shift_moves = A.shift_moves;
+
+  Out.Add(REGION_DIRECTORY, A.Directory.Data, A.block_count, sizeof(int));
+  Out.Add(REGION_FREE_WORDS, A.FreeSpace.Bits.Words.Data, A.FreeSpace.word_count, sizeof(unsigned long long));
+  Out.Add(REGION_FREE_NODES, A.FreeSpace.Nodes.Data, 2 * A.FreeSpace.word_count, sizeof(ExtentSummary));
+  SaveTable(Out, A.Table);
+
+  return Out.Close();
+}
+
+/*
+  This function replaces the whole state of a contiguous allocation
+  method, whatever it was built with, by the one saved in the image at
+  the given path, and sets next_id to the next ID of the experiment. The
+  directory and its free space index are mapped rather than read. The
+  placement policy is not saved, it is rebuilt from the free bitmap,
+  which takes no time for FirstFit. It returns FAIL if the image cannot
+  be restored, leaving the allocation method and next_id as they were
+*/
+template<typename Placement>
+int LoadSnapshot(string path, ContiguousAllocationT<Placement>& A, int& next_id) {
+
+  SnapshotImage Image;
+
+  if (Image.Open(path, SNAPSHOT_CONTIGUOUS) == FAIL) return FAIL;
+
+  SnapshotHeader& H = Image.Header;
+
+  // the free space tree is built over a power of two words
+  if ((H.word_count & (H.word_count - 1)) != 0) return FAIL;
+
+  BlockStorage<int> Directory;
+  BlockStorage<unsigned long long> Words;
+  BlockStorage<ExtentSummary> Nodes;
+  DirectoryTable Table;
+
+  if (Image.Map(REGION_DIRECTORY, Directory, H.block_count) == FAIL) return FAIL;
+  if (Image.Map(REGION_FREE_WORDS, Words, H.word_count) == FAIL) return FAIL;
+  if (Image.Map(REGION_FREE_NODES, Nodes, 2 * H.word_count) == FAIL) return FAIL;
+  if (LoadTable(Image, Table) == FAIL) return FAIL;
+
+  // nothing can fail from here on
+
+  A.block_size = H.block_size;
+  A.block_count = H.block_count;
+  A.available_space = H.available_space;
+  A.compactions = H.compactions;
+  A.blocks_moved = H.blocks_moved;
+  A.shift_moves = H.shift_moves;
+  A.FreeSpace.word_count = H.word_count;
+  A.FreeSpace.Bits.block_count = H.block_count;
+  A.FreeSpace.Bits.word_count = H.word_count;
+  A.Directory = move(Directory);
+  A.FreeSpace.Bits.Words = move(Words);
+  A.FreeSpace.Nodes = move(Nodes);
+  A.Table = move(Table);
+  next_id = H.next_id;
+
+  A.Policy = Placement();
+  A.Policy.Init(A.block_count);
+
+  if constexpr (is_same<Placement, FirstFit>::value) return SUCCESS;
+
+  // hand every used run to the policy
+  for (BlockIndex i = A.FreeSpace.Bits.FindNextUsed(0) ; i != FAIL ; ) {
+
+    BlockIndex j = A.FreeSpace.Bits.FindNextFree(i);
+
+    if (j == FAIL) j = A.block_count;
+
+    A.Policy.Reserve(i, j - i);
+    i = A.FreeSpace.Bits.FindNextUsed(j);
+  }
+
+  return SUCCESS;
+}
+
+/*
+  This function writes the state of a linked allocation method, along
+  with the next ID of the experiment, to an image at the given path. The
+  jump index is not written, see LoadSnapshot. It returns FAIL if the
+  image cannot be written
+*/
+int SaveSnapshot(string path, LinkedAllocation& A, int next_id) {
+
+  SnapshotWriter Out(path, SNAPSHOT_LINKED);
+
+  // the block size of the allocation method excludes the pointer
+  Out.Header.block_size = A.block_size + POINTER_SIZE;
+  Out.Header.block_count = A.block_count;
+  Out.Header.available_space = A.available_space;
+  Out.Header.next_id = next_id;
+  Out.Header.word_count = A.FreeBlocks.word_count;
+  Out.Header.jump_interval = A.jump_interval;
+  Out.Header.group_size = A.group_size;
+
+  Out.Add(REGION_DIRECTORY, A.Directory.Data, A.block_count, sizeof(LinkedFile));
+  Out.Add(REGION_FREE_WORDS, A.FreeBlocks.Words.Data, A.FreeBlocks.word_count, sizeof(unsigned long long));
+  SaveTable(Out, A.Table);
+
+  return Out.Close();
+}
+
+/*
+  This function replaces the whole state of a linked allocation method by
+  the one saved in the image at the given path, and sets next_id to the
+  next ID of the experiment. The directory and the free bitmap are mapped
+  rather than read. The jump index only speeds up Access, so it is rebuilt
+  by following the chains when the image has one, which takes time linear
+  in the number of blocks taken. Chains followed are checked to stay on
+  blocks of their file and to end after as many blocks as it has, and the
+  first and last blocks of every file to be on the directory. It returns
+  FAIL if the image cannot be restored, leaving the allocation method and
+  next_id as they were
+*/
+int LoadSnapshot(string path, LinkedAllocation& A, int& next_id) {
+
+  SnapshotImage Image;
+
+  if (Image.Open(path, SNAPSHOT_LINKED) == FAIL) return FAIL;
+
+  SnapshotHeader& H = Image.Header;
+
+  if (H.block_size <= POINTER_SIZE || H.jump_interval < 0 || H.group_size < 0) return FAIL;
+
+  BlockStorage<LinkedFile> Directory;
+  BlockStorage<unsigned long long> Words;
+  DirectoryTable Table;
+
+  if (Image.Map(REGION_DIRECTORY, Directory, H.block_count) == FAIL) return FAIL;
+  if (Image.Map(REGION_FREE_WORDS, Words, H.word_count) == FAIL) return FAIL;
+  if (LoadTable(Image, Table) == FAIL) return FAIL;
+
+  BlockIndex block_count = H.block_count;
+  bool valid = true;
+
+  Table.ForEach([&](int, File& F) {
+
+    if (F.block_len == 0) {
+      valid = valid && F.index == END_OF_FILE && F.tail == END_OF_FILE;
+    } else {
+      valid = valid && 0 < F.block_len && 0 <= F.index && F.index < block_count && 0 <= F.tail && F.tail < block_count;
+    }
+  });
+
+  if (!valid) return FAIL;
+
+  unordered_map<int, vector<BlockIndex>> Jumps;
+
+  if (H.jump_interval != 0) {
+
+    Table.ForEach([&](int fileID, File& F) {
+
+      if (!valid) return;
+
+      vector<BlockIndex>& List = Jumps[fileID];
+      BlockIndex index = F.index;
+
+      for (BlockIndex i = 0 ; i < F.block_len ; ++i, index = Directory[index].next) {
+
+        if (index < 0 || block_count <= index || Directory[index].state != fileID) {
+          valid = false;
+          return;
+        }
+
+        if (i % H.jump_interval == 0) List.push_back(index);
+      }
+
+      valid = index == END_OF_FILE;
+    });
+  }
+
+  if (!valid) return FAIL;
+
+  // nothing can fail from here on
+
+  A.block_size = H.block_size - POINTER_SIZE;
+  A.block_count = H.block_count;
+  A.available_space = H.available_space;
+  A.jump_interval = H.jump_interval;
+  A.group_size = H.group_size;
+  A.FreeBlocks.block_count = H.block_count;
+  A.FreeBlocks.word_count = H.word_count;
+  A.Directory = move(Directory);
+  A.FreeBlocks.Words = move(Words);
+  A.Table = move(Table);
+  A.Jumps = move(Jumps);
+  next_id = H.next_id;
+
+  return SUCCESS;
+}
+
+/*
+  Other allocation methods have no snapshot, saving or restoring them is
+  refused with REJECT
+*/
+template<typename Strategy>
+int SaveSnapshot(string, Strategy&, int) {
+  return REJECT;
+}
+
+template<typename Strategy>
+int LoadSnapshot(string, Strategy&, int&) {
+  return REJECT;
+}
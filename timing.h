@@ -0,0 +1,177 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAS_RDTSC
+#endif
+
+using namespace std;
+
+#define CLOCK_STEADY 0
+#define CLOCK_RDTSC 1
+
+#define TIMING_EVERY 0
+#define TIMING_SAMPLED 1
+#define TIMING_BATCH 2
+
+#define CALIBRATION_ROUNDS 1000
+
+/*
+  This struct type reads time from one of two clocks and turns intervals
+  into nanoseconds. Its attributes:
+
+  clock:        CLOCK_STEADY reads steady_clock, which is monotonic and
+                counts in nanoseconds. CLOCK_RDTSC reads the time stamp
+                counter, fenced so that the calls being timed cannot be
+                reordered around the reads, which is cheaper and finer.
+                Machines without a time stamp counter use steady_clock
+  ns_per_tick:  length of a tick in nanoseconds, calibrated against
+                steady_clock for the time stamp counter
+  overhead:     ticks measured by a start and stop with nothing between
+                them, subtracted from every interval
+*/
+struct Timer {
+
+  int clock;
+  double ns_per_tick;
+  long long overhead;
+
+  Timer(): clock(CLOCK_STEADY), ns_per_tick(1.0), overhead(0) {}
+
+  Timer(int _clock) {
+
+    clock = _clock;
+    ns_per_tick = 1.0;
+    overhead = 0;
+
+#ifndef HAS_RDTSC
+    clock = CLOCK_STEADY;
+#endif
+
+    Calibrate();
+  }
+
+  long long SteadyNow() const {
+    return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+  }
+
+  /*
+    Reads the clock at the start of an interval
+  */
+  long long Start() const {
+
+#ifdef HAS_RDTSC
+    if (clock == CLOCK_RDTSC) {
+
+      // wait for earlier instructions before reading the counter,
+      // and keep later ones from starting before it is read
+      _mm_lfence();
+      long long t = __rdtsc();
+      _mm_lfence();
+
+      return t;
+    }
+#endif
+
+    return SteadyNow();
+  }
+
+  /*
+    Reads the clock at the end of an interval
+  */
+  long long Stop() const {
+
+#ifdef HAS_RDTSC
+    if (clock == CLOCK_RDTSC) {
+
+      // rdtscp waits for earlier instructions to complete
+      unsigned int aux;
+      long long t = __rdtscp(&aux);
+      _mm_lfence();
+
+      return t;
+    }
+#endif
+
+    return SteadyNow();
+  }
+
+  /*
+    Returns the nanoseconds between two readings, less the overhead
+    of reading the clock
+  */
+  long long Elapsed(long long start, long long stop) const {
+
+    long long ticks = max(stop - start - overhead, 0LL);
+
+    return (long long) (ticks * ns_per_tick);
+  }
+
+  /*
+    This function measures the length of a tick, when reading the time
+    stamp counter, and the overhead of an empty interval, taken as the
+    median of CALIBRATION_ROUNDS intervals
+  */
+  void Calibrate() {
+
+    if (clock == CLOCK_RDTSC) {
+
+      long long steady_start = SteadyNow(), tsc_start = Start();
+
+      // spin for 20 milliseconds
+      while (SteadyNow() - steady_start < 20000000) {}
+
+      long long steady_stop = SteadyNow(), tsc_stop = Stop();
+
+      ns_per_tick = (double) (steady_stop - steady_start) / (tsc_stop - tsc_start);
+    }
+
+    vector<long long> Rounds(CALIBRATION_ROUNDS);
+
+    for (int i = 0 ; i < CALIBRATION_ROUNDS ; ++i) {
+      long long start = Start();
+      Rounds[i] = Stop() - start;
+    }
+
+    nth_element(Rounds.begin(), Rounds.begin() + CALIBRATION_ROUNDS / 2, Rounds.end());
+
+    overhead = Rounds[CALIBRATION_ROUNDS / 2];
+  }
+};
+
+/*
+  This struct type decides which calls of an experiment get timed, and
+  how their time is attributed. Its attributes:
+
+  mode:     TIMING_EVERY times every call on its own. TIMING_SAMPLED
+            only times one call out of period, so the clock is read less
+            often and averages are taken over the sampled calls.
+            TIMING_BATCH times runs of up to period consecutive calls of
+            the same type together, and charges every call of the run an
+            equal share, so cheap calls are not drowned by clock reads
+  period:   the sampling period or the batch length
+  counter:  number of calls seen so far, used for sampling
+*/
+struct TimingPolicy {
+
+  int mode;
+  int period;
+  long long counter;
+
+  TimingPolicy(): mode(TIMING_EVERY), period(1), counter(0) {}
+  TimingPolicy(int mode, int period): mode(mode), period(max(period, 1)), counter(0) {}
+
+  /*
+    Returns whether the next call should be timed on its own
+  */
+  bool Sample() {
+
+    if (mode == TIMING_SAMPLED) return counter++ % period == 0;
+
+    return mode == TIMING_EVERY;
+  }
+};
@@ -0,0 +1,385 @@
+#pragma once
+
+#include "file_data_structures.h"
+#include <charconv>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define OP_CREATE 0
+#define OP_ACCESS 1
+#define OP_EXTEND 2
+#define OP_SHRINK 3
+#define OP_INVALID 4
+
+/*
+  This struct type represents a single call read from a trace. Its
+  attributes:
+
+  code: one of the OP_ codes above
+  arg1: number of bytes for creation, file index for the other calls
+  arg2: byte offset for access, number of blocks for extension and
+        shrinking, unused for creation
+*/
+struct Op {
+
+  int code;
+  long long arg1;
+  long long arg2;
+
+  Op(): code(OP_INVALID), arg1(0), arg2(0) {}
+  Op(int code, long long arg1, long long arg2): code(code), arg1(arg1), arg2(arg2) {}
+};
+
+#define TRACE_MAGIC "FSTRACE"
+#define TRACE_VERSION 1
+
+/*
+  This struct type is the header of a binary trace file. A binary trace
+  is the header followed by op_count records of type TraceRecord, both
+  stored in the byte order of the machine that wrote them. Its attributes:
+
+  magic:      TRACE_MAGIC, used to tell binary traces from text ones
+  version:    TRACE_VERSION at the time the file was written
+  block_size: the block size the trace was generated for
+  op_count:   total number of records in the file
+  counts:     number of records of every op code, indexed by code
+*/
+struct TraceHeader {
+
+  char magic[8];
+  int version;
+  int block_size;
+  long long op_count;
+  long long counts[OP_INVALID];
+};
+
+/*
+  This struct type is a single fixed width record of a binary trace. The
+  op code takes the low 8 bits of head and arg1 the remaining 56 bits, so
+  a record is decoded with a shift and a mask.
+*/
+struct TraceRecord {
+
+  unsigned long long head;
+  long long arg2;
+
+  TraceRecord() {}
+  TraceRecord(const Op& op): head((unsigned long long) op.arg1 << 8 | op.code), arg2(op.arg2) {}
+
+  Op Decode() const {
+    return Op(head & 0xFF, head >> 8, arg2);
+  }
+};
+
+/*
+  This struct type reads the calls of a trace file. Text traces have one
+  call per line, each being one of c:bytes, a:file:offset, e:file:amount
+  or sh:file:amount. Binary traces start with a TraceHeader and are told
+  apart by their magic. The file is memory mapped and records are decoded
+  in place, so reading a trace does not allocate memory per record. Its
+  attributes:
+
+  Data:     the mapped contents of the file
+  size:     the length of the file in bytes
+  pos:      the position of the next record to be decoded
+  binary:   whether the file is a binary trace
+  Header:   the header of a binary trace, for text traces only
+            block_size is left unknown (zero)
+*/
+struct TraceReader {
+
+  const char* Data;
+  size_t size;
+  size_t pos;
+  bool binary;
+  TraceHeader Header;
+
+  TraceReader(): Data(NULL), size(0), pos(0), binary(false) {}
+
+  TraceReader(const TraceReader&) = delete;
+  TraceReader& operator=(const TraceReader&) = delete;
+
+  ~TraceReader() {
+    Close();
+  }
+
+  /*
+    This function maps the file at the given path, and returns FAIL if
+    it cannot be opened
+  */
+  int Open(string path) {
+
+    Close();
+
+    int fd = open(path.c_str(), O_RDONLY);
+
+    if (fd < 0) return FAIL;
+
+    struct stat st;
+
+    if (fstat(fd, &st) < 0) {
+      close(fd);
+      return FAIL;
+    }
+
+    size = st.st_size;
+
+    // an empty file cannot be mapped, it is simply a trace with no calls
+    if (size != 0) {
+
+      void* ptr = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+      if (ptr == MAP_FAILED) {
+        close(fd);
+        size = 0;
+        return FAIL;
+      }
+
+      madvise(ptr, size, MADV_SEQUENTIAL);
+      Data = (const char*) ptr;
+    }
+
+    // the mapping stays valid after the descriptor is closed
+    close(fd);
+
+    pos = 0;
+    binary = sizeof(TraceHeader) <= size && memcmp(Data, TRACE_MAGIC, sizeof(TRACE_MAGIC)) == 0;
+    memset(&Header, 0, sizeof(Header));
+
+    if (binary) {
+
+      memcpy(&Header, Data, sizeof(Header));
+
+      // reject files written by another version or cut short
+      if (Header.version != TRACE_VERSION || size != sizeof(TraceHeader) + Header.op_count * sizeof(TraceRecord)) {
+        Close();
+        return FAIL;
+      }
+
+      pos = sizeof(TraceHeader);
+    }
+
+    return SUCCESS;
+  }
+
+  void Close() {
+
+    if (Data != NULL) munmap((void*) Data, size);
+
+    Data = NULL;
+    size = 0;
+    pos = 0;
+    binary = false;
+  }
+
+  /*
+    Parses an integer at the current position, followed by an optional
+    ':' separator which is skipped
+  */
+  long long ReadInt() {
+
+    long long x = 0;
+
+    from_chars_result res = from_chars(Data + pos, Data + size, x);
+
+    pos = res.ptr - Data;
+
+    if (pos < size && Data[pos] == ':') pos++;
+
+    return x;
+  }
+
+  /*
+    This function decodes the next record of the trace into op. It returns
+    false once the end of the trace is reached. Records that cannot be
+    recognized are returned with the OP_INVALID code.
+  */
+  bool Next(Op& op) {
+
+    if (binary) {
+
+      if (pos == size) return false;
+
+      TraceRecord R;
+      memcpy(&R, Data + pos, sizeof(R));
+      pos += sizeof(R);
+
+      op = R.Decode();
+
+      return true;
+    }
+
+    // skip line breaks and any other whitespace between records
+    while (pos < size && isspace((unsigned char) Data[pos])) pos++;
+
+    if (pos == size) return false;
+
+    const char* line = Data + pos;
+    size_t left = size - pos;
+
+    op = Op();
+
+    if (2 <= left && line[0] == 'c' && line[1] == ':') {
+
+      pos += 2;
+      op.code = OP_CREATE;
+      op.arg1 = ReadInt();
+
+    } else if (2 <= left && (line[0] == 'a' || line[0] == 'e') && line[1] == ':') {
+
+      pos += 2;
+      op.code = line[0] == 'a' ? OP_ACCESS : OP_EXTEND;
+      op.arg1 = ReadInt();
+      op.arg2 = ReadInt();
+
+    } else if (3 <= left && line[0] == 's' && line[1] == 'h' && line[2] == ':') {
+
+      pos += 3;
+      op.code = OP_SHRINK;
+      op.arg1 = ReadInt();
+      op.arg2 = ReadInt();
+    }
+
+    // move past whatever is left of the line
+    while (pos < size && !isspace((unsigned char) Data[pos])) pos++;
+
+    return true;
+  }
+};
+
+/*
+  This function converts the text trace at text_path into a binary trace
+  written to binary_path, recording the given block size in its header.
+  It returns FAIL if a file cannot be opened or written, or the text
+  trace contains a record that cannot be recognized, and then removes
+  whatever was written to binary_path.
+*/
+int ConvertTrace(string text_path, string binary_path, int block_size) {
+
+  TraceReader Reader;
+
+  if (Reader.Open(text_path) == FAIL) return FAIL;
+
+  FILE* out = fopen(binary_path.c_str(), "wb");
+
+  if (out == NULL) return FAIL;
+
+  TraceHeader Header;
+  memset(&Header, 0, sizeof(Header));
+  memcpy(Header.magic, TRACE_MAGIC, sizeof(TRACE_MAGIC));
+  Header.version = TRACE_VERSION;
+  Header.block_size = block_size;
+
+  // the header is written again once the counts are known
+  bool written = fwrite(&Header, sizeof(Header), 1, out) == 1;
+
+  Op op;
+
+  while (written && Reader.Next(op)) {
+
+    if (op.code == OP_INVALID) {
+      written = false;
+      break;
+    }
+
+    TraceRecord R(op);
+    written = fwrite(&R, sizeof(R), 1, out) == 1;
+
+    Header.op_count++;
+    Header.counts[op.code]++;
+  }
+
+  written = written && fseek(out, 0, SEEK_SET) == 0 && fwrite(&Header, sizeof(Header), 1, out) == 1;
+
+  if (fclose(out) != 0) written = false;
+
+  if (!written) {
+    remove(binary_path.c_str());
+    return FAIL;
+  }
+
+  return SUCCESS;
+}
+
+/*
+  This struct type holds a whole trace decoded into memory as a structure
+  of arrays, so that it can be replayed any number of times without being
+  read or parsed again. Its attributes:
+
+  block_size: the block size recorded in a binary trace, zero otherwise
+  Codes:      the op code of every call
+  Arg1:       the first argument of every call
+  Arg2:       the second argument of every call
+*/
+struct OpBuffer {
+
+  int block_size;
+  vector<unsigned char> Codes;
+  vector<long long> Arg1;
+  vector<long long> Arg2;
+
+  OpBuffer(): block_size(0) {}
+
+  /*
+    This function decodes the whole trace at the given path, either text
+    or binary, into the buffer. It returns FAIL if the file cannot be
+    opened, in which case the buffer is left empty.
+  */
+  int Load(string path) {
+
+    Codes.clear();
+    Arg1.clear();
+    Arg2.clear();
+
+    TraceReader Reader;
+
+    if (Reader.Open(path) == FAIL) return FAIL;
+
+    block_size = Reader.Header.block_size;
+
+    // binary traces know their length, so the arrays are sized once
+    if (Reader.binary) {
+      Codes.reserve(Reader.Header.op_count);
+      Arg1.reserve(Reader.Header.op_count);
+      Arg2.reserve(Reader.Header.op_count);
+    }
+
+    Op op;
+
+    while (Reader.Next(op)) {
+      Codes.push_back(op.code);
+      Arg1.push_back(op.arg1);
+      Arg2.push_back(op.arg2);
+    }
+
+    return SUCCESS;
+  }
+
+  size_t size() const {
+    return Codes.size();
+  }
+};
+
+/*
+  This struct type replays an OpBuffer from its start, one call at a time.
+  Several cursors can replay the same buffer at the same time.
+*/
+struct OpCursor {
+
+  const OpBuffer& Ops;
+  size_t pos;
+
+  OpCursor(const OpBuffer& Ops): Ops(Ops), pos(0) {}
+
+  bool Next(Op& op) {
+
+    if (pos == Ops.size()) return false;
+
+    op = Op(Ops.Codes[pos], Ops.Arg1[pos], Ops.Arg2[pos]);
+    pos++;
+
+    return true;
+  }
+};
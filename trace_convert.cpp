@@ -0,0 +1,21 @@
+#include "trace.h"
+
+/*
+  Converts a text trace into the binary trace format, usage:
+
+  ./trace_convert <text trace> <binary trace> <block size>
+*/
+int main(int argc, char** argv) {
+
+  if (argc != 4) {
+    cerr << "Usage: " << argv[0] << " <text trace> <binary trace> <block size>\n";
+    return 1;
+  }
+
+  if (ConvertTrace(argv[1], argv[2], atoi(argv[3])) == FAIL) {
+    cerr << "Conversion of " << argv[1] << " failed\n";
+    return 1;
+  }
+
+  return 0;
+}
@@ -0,0 +1,201 @@
+#pragma once
+
+#include "trace.h"
+#include <cmath>
+#include <random>
+
+#define DIST_UNIFORM 0
+#define DIST_ZIPF 1
+#define DIST_PARETO 2
+
+/*
+  This struct type describes a synthetic workload. Its attributes:
+
+  block_size:     the block size the workload is generated for
+  file_count:     number of files created, creations stop once all of
+                  them exist
+  op_count:       total number of calls to generate
+  create_ratio:   relative weights of the four kinds of call, they do
+  access_ratio:   not need to add up to anything
+  extend_ratio:
+  shrink_ratio:
+  size_dist:      distribution of file sizes at creation, one of the
+                  DIST_ codes, between min_bytes and max_bytes
+  amount_dist:    distribution of the number of blocks of extensions
+                  and shrinks, between 1 and max_amount
+  max_blocks:     bound on the total size in blocks of all files, calls
+                  that would grow files past it shrink them instead, so
+                  that long workloads reach a steady state instead of
+                  filling the volume
+  file_dist:      distribution of the file targeted by the other calls,
+                  the lowest file indices being the hottest under Zipf
+                  and Pareto
+  skew:           exponent of the Zipf and Pareto distributions
+  seed:           seed of the random generator, the same configuration
+                  and seed always generate the same calls
+*/
+struct WorkloadConfig {
+
+  int block_size = 1024;
+  int file_count = 200;
+  long long op_count = 1000000;
+  double create_ratio = 1;
+  double access_ratio = 1;
+  double extend_ratio = 7;
+  double shrink_ratio = 7;
+  int size_dist = DIST_UNIFORM;
+  long long min_bytes = 1;
+  long long max_bytes = 100000;
+  int amount_dist = DIST_UNIFORM;
+  long long max_amount = 150;
+  long long max_blocks = 24576;
+  int file_dist = DIST_UNIFORM;
+  double skew = 1.0;
+  unsigned long long seed = 1;
+};
+
+/*
+  This struct type generates the calls of a synthetic workload one at a
+  time, so that workloads of any length can be replayed without being
+  written to a file or held in memory. It keeps the size in blocks every
+  file would have if no call were rejected, so that accesses stay within
+  files and shrinks never remove a whole file. Its attributes:
+
+  Config:     the workload being generated
+  Rand:       the random generator
+  Blocks:     the expected size in blocks of every created file
+  Bytes:      the expected size in bytes of every created file
+  total:      the expected size in blocks of all files
+  generated:  number of calls generated so far
+*/
+struct WorkloadGenerator {
+
+  WorkloadConfig Config;
+  mt19937_64 Rand;
+  vector<long long> Blocks;
+  vector<long long> Bytes;
+  long long total;
+  long long generated;
+
+  WorkloadGenerator(const WorkloadConfig& _Config): Config(_Config), Rand(_Config.seed), total(0), generated(0) {
+    Blocks.reserve(Config.file_count);
+    Bytes.reserve(Config.file_count);
+  }
+
+  /*
+    Returns a uniformly distributed number in [0, 1)
+  */
+  double Uniform() {
+    return (Rand() >> 11) * 0x1.0p-53;
+  }
+
+  /*
+    Returns a number in [low, high] drawn from the given distribution.
+    Zipf is sampled by inverting the continuous power law with the same
+    exponent, which is exact enough for workloads and takes constant time
+    for any range. Pareto is bounded to the range.
+  */
+  long long Draw(int dist, long long low, long long high) {
+
+    if (high <= low) return low;
+
+    double u = Uniform();
+    double n = high - low + 1;
+    double x;
+
+    if (dist == DIST_ZIPF) {
+
+      if (fabs(Config.skew - 1.0) < 1e-9) {
+        x = pow(n + 1, u);
+      } else {
+        double e = 1.0 - Config.skew;
+        x = pow((pow(n + 1, e) - 1) * u + 1, 1.0 / e);
+      }
+
+      x -= 1;
+
+    } else if (dist == DIST_PARETO) {
+
+      // bounded Pareto over [1, n + 1)
+      double a = Config.skew;
+      x = 1.0 / pow(1 - u * (1 - pow(1.0 / (n + 1), a)), 1.0 / a) - 1;
+
+    } else {
+      x = u * n;
+    }
+
+    return low + min((long long) x, high - low);
+  }
+
+  /*
+    This function generates the next call into op, and returns false once
+    op_count calls have been generated
+  */
+  bool Next(Op& op) {
+
+    if (generated == Config.op_count || Config.file_count <= 0) return false;
+
+    generated++;
+
+    bool can_create = (int) Blocks.size() < Config.file_count;
+
+    double create = can_create ? Config.create_ratio : 0;
+    double weight = create + Config.access_ratio + Config.extend_ratio + Config.shrink_ratio;
+    double pick = Uniform() * weight;
+
+    // the first call has to create a file
+    if (Blocks.empty() || pick < create) {
+
+      long long bytes = Draw(Config.size_dist, Config.min_bytes, Config.max_bytes);
+
+      Blocks.push_back((bytes + Config.block_size - 1) / Config.block_size);
+      Bytes.push_back(bytes);
+      total += Blocks.back();
+      op = Op(OP_CREATE, bytes, 0);
+
+      return true;
+    }
+
+    pick -= create;
+
+    long long file = Draw(Config.file_dist, 0, Blocks.size() - 1);
+
+    bool shrink = false;
+
+    if (pick < Config.extend_ratio) {
+
+      long long amount = Draw(Config.amount_dist, 1, Config.max_amount);
+
+      if (total + amount <= Config.max_blocks) {
+
+        Blocks[file] += amount;
+        Bytes[file] += amount * Config.block_size;
+        total += amount;
+        op = Op(OP_EXTEND, file, amount);
+
+        return true;
+      }
+
+      shrink = true;
+    }
+
+    pick -= Config.extend_ratio;
+
+    // a file of a single block cannot be shrunk, it is accessed instead
+    if ((shrink || pick < Config.shrink_ratio) && 1 < Blocks[file]) {
+
+      long long amount = Draw(Config.amount_dist, 1, min(Config.max_amount, Blocks[file] - 1));
+
+      Blocks[file] -= amount;
+      Bytes[file] -= amount * Config.block_size;
+      total -= amount;
+      op = Op(OP_SHRINK, file, amount);
+
+      return true;
+    }
+
+    op = Op(OP_ACCESS, file, Draw(DIST_UNIFORM, 0, Bytes[file] - 1));
+
+    return true;
+  }
+};